@@ -0,0 +1,6 @@
+@echo off
+rem %1 is a queue file: <arrival ms> <priority> <deadline ms> <cap code> <func> <message> per line
+:start
+pocsag2sdr -w \\.\com1 -t 500 --max-key 60000 -q %1
+timeout 1
+goto start
@@ -0,0 +1,141 @@
+/*
+File:	airtime.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Airtime accounting: bits, seconds, samples and bytes of a transmission counted from the segment layout
+in O(segments) time, without rendering anything. Sample counts follow the arithmetic of the renderers,
+so they match the output exactly.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "pocsag2sdr.h"
+#include "airtime.h"
+#include "wav.h"
+#include "uart.h"
+
+void air_count_bits(POCSAG_tx *p_tx, AIR_count *ac) {
+	POCSAG_tx *seg;
+	memset(ac, 0, sizeof(AIR_count));
+	for (seg = p_tx; seg != NULL; seg = seg->next) {
+		uint64_t bits = tx_bits(seg);
+		ac->segments++;
+		ac->batches += seg->n_batches;
+		ac->bits += bits;
+		ac->seconds += (double)bits / (double)seg->baud_rate;
+	}
+}
+
+// fsk_start_offset(): zero samples up to the next bit edge at <offset>
+static void iq_start_offset(AIR_count *ac, uint64_t *edge_frac, uint32_t bps, double offset) {
+	uint64_t first = (uint64_t)ceil(offset);
+	if (first < ac->samples) {
+		first = ac->samples;
+		offset = (double)first;
+	}
+	*edge_frac = (uint64_t)lrint(((double)first - offset) * bps);
+	if (*edge_frac >= bps) *edge_frac = bps - 1;
+	ac->samples = first;
+}
+
+// fsk_output_bit(): rounded samples per bit, or exact fractional timing after fsk_start_offset().
+// If timed is set, every segment starts at offset + start_ms as queued transmissions are rendered
+void air_count_iq(POCSAG_tx *p_tx, uint32_t sample_rate, int exact, double offset, int timed, AIR_count *ac) {
+	POCSAG_tx *seg;
+	uint32_t bps = p_tx->baud_rate;
+	uint64_t edge_frac = 0;
+
+	air_count_bits(p_tx, ac);
+	if (exact) iq_start_offset(ac, &edge_frac, bps, offset);
+	for (seg = p_tx; seg != NULL; seg = seg->next) {
+		uint64_t bits = tx_bits(seg);
+		if (seg->baud_rate != bps) {
+			edge_frac = edge_frac * seg->baud_rate / bps;
+			bps = seg->baud_rate;
+		}
+		if (timed) {
+			iq_start_offset(ac, &edge_frac, bps, offset + (double)seg->start_ms * sample_rate / 1000.0);
+			exact = 1;
+		}
+		if (exact) {
+			// every bit takes the samples starting within it, edge_frac carries the remainder
+			uint64_t n = (bits * sample_rate - edge_frac + bps - 1) / bps;
+			edge_frac = n * bps + edge_frac - bits * sample_rate;
+			ac->samples += n;
+		} else {
+			ac->samples += bits * lrint((double)sample_rate / (double)bps);
+		}
+	}
+	ac->bytes = ac->samples * 2;
+}
+
+// wav_start_offset(): silent samples up to the next bit edge at <offset>
+static void wav_offset(AIR_count *ac, uint64_t *fill, uint32_t bps, double offset) {
+	uint64_t n = (uint64_t)floor(offset);
+	uint64_t f;
+	if (n < ac->samples) return;
+	if (n > ac->samples && *fill != 0) {
+		ac->samples++;
+		*fill = 0;
+	}
+	ac->samples = n;
+	f = (uint64_t)lrint((offset - (double)n) * bps);
+	if (f >= bps) f = bps - 1;
+	if (f > *fill) *fill = f;
+}
+
+// wav_output_bit(): a sample is put out every bit_rate units, the filter delay and tail cancel out
+void air_count_wav(POCSAG_tx *p_tx, uint32_t sample_rate, double offset, int timed, int header, AIR_count *ac) {
+	POCSAG_tx *seg;
+	uint32_t bps = p_tx->baud_rate;
+	uint64_t fill = 0;
+
+	air_count_bits(p_tx, ac);
+	if (offset > 0) wav_offset(ac, &fill, bps, offset);
+	for (seg = p_tx; seg != NULL; seg = seg->next) {
+		if (seg->baud_rate != bps) {
+			fill = fill * seg->baud_rate / bps;
+			bps = seg->baud_rate;
+		}
+		if (timed) wav_offset(ac, &fill, bps, offset + (double)seg->start_ms * sample_rate / 1000.0);
+		fill += tx_bits(seg) * sample_rate;
+		ac->samples += fill / bps;
+		fill %= bps;
+	}
+	if (fill != 0) ac->samples++;
+	ac->bytes = ac->samples * 2 + (header ? WAV_HDR_LEN : 0);
+}
+
+// uart_output_bit(): UART bit periods which centres fall inside the POCSAG bits, whole characters at the end
+// of every segment if per_segment is set (queued transmissions via COM port), otherwise at the end only
+void air_count_uart(POCSAG_tx *p_tx, uint32_t uart_baud, int per_segment, AIR_count *ac) {
+	POCSAG_tx *seg;
+	double bit_start = 0;
+	uint64_t uart_bits = 0;
+
+	air_count_bits(p_tx, ac);
+	for (seg = p_tx; seg != NULL; seg = seg->next) {
+		bit_start += (double)tx_bits(seg) * (double)uart_baud / (double)seg->baud_rate;
+		uart_bits = (uint64_t)ceil(bit_start - 0.5);
+		if (per_segment || seg->next == NULL) {
+			uart_bits = (uart_bits + UART_CHAR_BITS - 1) / UART_CHAR_BITS * UART_CHAR_BITS;
+			bit_start = (double)uart_bits;
+		}
+	}
+	ac->samples = uart_bits;
+	ac->bytes = uart_bits / UART_CHAR_BITS;
+}
+
+// write_cw_segment(): 16 codewords of every batch, the sync codeword isn't stored
+void air_count_cw(POCSAG_tx *p_tx, AIR_count *ac) {
+	POCSAG_tx *seg;
+	air_count_bits(p_tx, ac);
+	ac->bytes = CW_FILE_HDR_LEN;
+	for (seg = p_tx; seg != NULL; seg = seg->next) {
+		ac->bytes += CW_SEG_HDR_LEN + (uint64_t)seg->n_batches * 16 * 4;
+	}
+}
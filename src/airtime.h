@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+// POCSAG_tx comes from pocsag2sdr.h which must be included first
+
+// what a transmission takes on air and in the output, counted without rendering
+typedef struct AIR_count {
+	uint32_t segments;
+	uint64_t batches;
+	uint64_t bits;
+	double seconds;			// airtime, every segment at its own baud rate
+	uint64_t samples;		// I/Q or audio samples, UART bit periods
+	uint64_t bytes;			// output size
+} AIR_count;
+
+void air_count_bits(POCSAG_tx *p_tx, AIR_count *ac);
+void air_count_iq(POCSAG_tx *p_tx, uint32_t sample_rate, int exact, double offset, int timed, AIR_count *ac);
+void air_count_wav(POCSAG_tx *p_tx, uint32_t sample_rate, double offset, int timed, int header, AIR_count *ac);
+void air_count_uart(POCSAG_tx *p_tx, uint32_t uart_baud, int per_segment, AIR_count *ac);
+void air_count_cw(POCSAG_tx *p_tx, AIR_count *ac);
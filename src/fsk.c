@@ -14,20 +14,25 @@ For any other purposes please contact me at e-mail above or any other e-mail lis
 #include <math.h>
 
 #include "fsk.h"
+#include "writer.h"
 #include "my_strerror.h"
+#include "stats.h"
 
 static uint32_t cycles;
-static FILE *output_file;
 static FSK_params *fsk_p;
+static int8_t *out_buf;
+static uint32_t out_len, out_size;
 
-int init_fsk(uint32_t sample_rate, uint32_t dev, uint32_t bps,uint32_t ampl,FILE *ofp) {
+int init_fsk(uint32_t sample_rate, uint32_t dev, uint32_t bps,uint32_t ampl) {
 	uint32_t i;
+	STATS_START(t0);
 
-	fsk_p = malloc(sizeof(FSK_params));
+	fsk_p = calloc(1, sizeof(FSK_params));
 	if (fsk_p == NULL) {
 		set_error(ERR_ERRNO, "[malloc]");
 		return (-1);
 	}
+	STATS_ALLOC(STAGE_SETUP);
 
 	fsk_p->sample_rate = sample_rate;
 	fsk_p->dev = dev;
@@ -43,11 +48,13 @@ int init_fsk(uint32_t sample_rate, uint32_t dev, uint32_t bps,uint32_t ampl,FILE
 		set_error(ERR_ERRNO, "[malloc]");
 		return (-1);
 	}
+	STATS_ALLOC(STAGE_SETUP);
 	fsk_p->coss = malloc(fsk_p->divider*sizeof(double));
 	if (fsk_p->coss == NULL) {
 		set_error(ERR_ERRNO, "[malloc]");
 		return (-1);
 	}
+	STATS_ALLOC(STAGE_SETUP);
 
 	for (i = 0; i < fsk_p->divider; i++) {
 		double t;
@@ -57,28 +64,164 @@ int init_fsk(uint32_t sample_rate, uint32_t dev, uint32_t bps,uint32_t ampl,FILE
 		fsk_p->coss[i] = (double)ampl*cos(t);
 	}
 	cycles = 0;
-	output_file = ofp;
+	out_buf = NULL;
+	out_len = 0;
+	STATS_STOP(STAGE_SETUP, t0, 0, 0);
 
 	return 0;
 }
 
+// switches to another bit rate keeping the carrier phase, so segments follow each other seamlessly
+int fsk_set_bit_rate(uint32_t bps) {
+	if (bps == 0) {
+		set_error(ERR_MSG, "Invalid bit rate");
+		return (-1);
+	}
+	fsk_p->edge_frac = (uint32_t)((uint64_t)fsk_p->edge_frac * bps / fsk_p->bit_rate);
+	fsk_p->bit_rate = bps;
+	fsk_p->cycles_per_bit_d = (double)fsk_p->sample_rate / (double)bps;
+	fsk_p->cycles_per_bit = lrint(fsk_p->cycles_per_bit_d);
+	return 0;
+}
+
+static int flush_fsk(void) {
+	// the filled buffer is handed over to the writer thread
+	if (writer_submit(out_len) == (-1)) return (-1);
+	out_buf = NULL;
+	out_len = 0;
+	return 0;
+}
+
+// starts the next bit <offset> samples after the beginning of the output with zero energy samples before it,
+// e.g. the first bit of a file or the next queued transmission; bit edges keep exact fractional timing from then on,
+// so they don't drift against the target times. An offset already passed starts the bit right away
+int fsk_start_offset(double offset) {
+	uint64_t first = (uint64_t)ceil(offset);
+	uint64_t n, i;
+	if (first < fsk_p->samples) {
+		first = fsk_p->samples;
+		offset = (double)first;
+	}
+	n = first - fsk_p->samples;
+	fsk_p->exact = 1;
+	fsk_p->edge_frac = (uint32_t)lrint(((double)first - offset) * fsk_p->bit_rate);
+	if (fsk_p->edge_frac >= fsk_p->bit_rate) fsk_p->edge_frac = fsk_p->bit_rate - 1;
+	if (fsk_p->samples == 0) fsk_p->lead_samples = n;
+	for (i = 0; i < n; i++) {
+		if (out_buf == NULL) {
+			out_buf = (int8_t *)writer_buffer();
+			out_size = get_writer_params()->buf_size;
+		}
+		out_buf[out_len++] = 0;
+		out_buf[out_len++] = 0;
+		if (out_len == out_size) {
+			if (flush_fsk() == (-1)) return (-1);
+		}
+	}
+	fsk_p->samples += n;
+	return 0;
+}
+
 int fsk_output_bit(int bit) {
 	unsigned int t;
-	for (t = 0; t < fsk_p->cycles_per_bit; t++) {
-		int8_t buf[2];
-
-		buf[0] = bit ? (uint8_t)fsk_p->sins[cycles] : (uint8_t)((-1)*fsk_p->sins[cycles]);
-		buf[1] = (uint8_t)fsk_p->coss[cycles];
-		fwrite(buf, 1, 2, output_file);
-		if (ferror(output_file)) {
-			set_error(ERR_ERRNO, "[fwrite]");
-			return (-1);
+	uint32_t n = fsk_p->cycles_per_bit;
+	STATS_START(t0);
+	if (fsk_p->exact) {
+		// samples which start within the bit
+		n = (fsk_p->sample_rate - fsk_p->edge_frac + fsk_p->bit_rate - 1) / fsk_p->bit_rate;
+		fsk_p->edge_frac = n * fsk_p->bit_rate + fsk_p->edge_frac - fsk_p->sample_rate;
+	}
+	for (t = 0; t < n; t++) {
+		if (out_buf == NULL) {
+			out_buf = (int8_t *)writer_buffer();
+			out_size = get_writer_params()->buf_size;
 		}
+		out_buf[out_len++] = bit ? (int8_t)fsk_p->sins[cycles] : (int8_t)((-1)*fsk_p->sins[cycles]);
+		out_buf[out_len++] = (int8_t)fsk_p->coss[cycles];
 		if (++cycles >= fsk_p->divider) cycles = 0;
+		if (out_len == out_size) {
+			if (flush_fsk() == (-1)) return (-1);
+		}
 	}
+	fsk_p->samples += n;
+	fsk_p->last_bit = bit;
+	STATS_STOP(STAGE_SYNTH, t0, (uint64_t)n * 2, n);
 	return 0;
 }
 
+// Pads the output so it can be looped seamlessly: it has to end on a bit boundary with the carrier phase back at zero,
+// i.e. after a whole number of carrier cycles. With a gap the zero samples are stretched to the next cycle boundary
+// while the carrier keeps running, so the loop is exact. Without one, the fewest bits are added which bring the phase
+// within tol_deg degrees, or as close as possible if it can't be reached: idle codewords, then the low bits of
+// the alternating pad_bits pattern. Only lengths which start with the opposite of the preceding bit and end with
+// the opposite of the first preamble bit are used, so the pad just lengthens the preamble of the next round.
+int fsk_loop_pad(uint32_t pad_cw, uint32_t pad_bits, int inv, uint64_t gap, double tol_deg) {
+	uint64_t d = fsk_p->divider;
+	uint64_t n, r;
+	uint32_t t, bits = 0;
+	int j;
+
+	if (gap != 0) {
+		gap += (d - (fsk_p->samples + gap) % d) % d;
+	} else {
+		double tol = tol_deg / 360.0 * (double)d;
+		int64_t best = (int64_t)d;
+		// residues repeat after d bits at most, twice that with every other length skipped
+		for (t = 0; t < 2 * d; t++) {
+			int64_t e;
+			int prev = t >= 32 ? (int)(pad_cw & 1) ^ inv : fsk_p->last_bit;
+			int last = prev;
+			if (t % 32 != 0) {
+				if ((((int)(pad_bits >> (t % 32 - 1)) & 1) ^ inv) == prev) continue;
+				last = (int)(pad_bits & 1) ^ inv;
+			}
+			// the pad must also end with the opposite of the first preamble bit, a pad of idle codewords can't
+			if (last == (((int)(pad_bits >> 31) & 1) ^ inv)) continue;
+			e = (int64_t)((fsk_p->samples + (uint64_t)t * fsk_p->cycles_per_bit) % d);
+			if (e > (int64_t)d / 2) e -= (int64_t)d;
+			if (llabs(e) < llabs(best)) {
+				best = e;
+				bits = t;
+			}
+			if ((double)llabs(e) <= tol) break;
+		}
+	}
+	fsk_p->pad_cws = bits / 32;
+	fsk_p->pad_bits = bits % 32;
+	for (t = 0; t < bits; t++) {
+		if (t < fsk_p->pad_cws * 32) {
+			j = 31 - t % 32;
+			if (fsk_output_bit(((pad_cw >> j) & 1) ^ inv) == (-1)) return (-1);
+		} else {
+			j = fsk_p->pad_bits - 1 - (t - fsk_p->pad_cws * 32);
+			if (fsk_output_bit(((pad_bits >> j) & 1) ^ inv) == (-1)) return (-1);
+		}
+	}
+
+	fsk_p->gap_samples = gap;
+	for (n = 0; n < gap; n++) {
+		if (out_buf == NULL) {
+			out_buf = (int8_t *)writer_buffer();
+			out_size = get_writer_params()->buf_size;
+		}
+		out_buf[out_len++] = 0;
+		out_buf[out_len++] = 0;
+		if (++cycles >= fsk_p->divider) cycles = 0;
+		if (out_len == out_size) {
+			if (flush_fsk() == (-1)) return (-1);
+		}
+	}
+	fsk_p->samples += gap;
+	r = fsk_p->samples % d;
+	fsk_p->phase_err = r > d / 2 ? (int64_t)r - (int64_t)d : (int64_t)r;
+	return 0;
+}
+
+int end_fsk(void) {
+	if (flush_fsk() == (-1)) return (-1);
+	return end_writer();
+}
+
 FSK_params *get_fsk_params(void) {
 	return fsk_p;
 }
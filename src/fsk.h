@@ -12,10 +12,26 @@ typedef struct FSK_params {
 	double divider_d;
 	double cycles_per_bit_d;
 
+	// exact fractional bit timing, used for time-aligned output
+	int exact;
+	uint32_t edge_frac;		// from the ideal bit edge to the first sample of the bit, in 1/bit_rate of a sample
+	uint64_t lead_samples;	// zero samples before the first bit
+
+	uint64_t samples;		// I/Q samples written so far
+	int last_bit;			// level of the last bit, as sent
+	// loop padding, see fsk_loop_pad()
+	uint32_t pad_cws, pad_bits;
+	uint64_t gap_samples;
+	int64_t phase_err;		// carrier phase error at the loop point in samples
+
 	double *sins;
 	double *coss;
 } FSK_params;
 
-int init_fsk(uint32_t sample_rate, uint32_t dev, uint32_t bps, uint32_t ampl,FILE *ofp);
+int init_fsk(uint32_t sample_rate, uint32_t dev, uint32_t bps, uint32_t ampl);
+int fsk_set_bit_rate(uint32_t bps);
+int fsk_start_offset(double offset);
 int fsk_output_bit(int bit);
+int fsk_loop_pad(uint32_t pad_cw, uint32_t pad_bits, int inv, uint64_t gap, double tol_deg);
+int end_fsk(void);
 FSK_params *get_fsk_params(void);
@@ -5,6 +5,7 @@ enum {
 #ifdef WIN32
 	, ERR_WIN32
 #endif // WIN32
+	, ERR_MSG		// message only, without system error description
 	, ERR_MAX
 };
 
@@ -7,8 +7,10 @@ For any other purposes please contact me at e-mail above or any other e-mail lis
 */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "pocsag2sdr.h"
+#include "stats.h"
 
 POCSAG_batch *create_batch(void) {
 	POCSAG_batch *batch;
@@ -28,28 +30,46 @@ POCSAG_batch *create_batch(void) {
 
 POCSAG_tx *create_preamble(void) {
 	POCSAG_tx *tx;
-	int i;
 	tx = malloc(sizeof(POCSAG_tx));
 	if (tx == NULL) {
 		set_error(ERR_ERRNO, "[malloc]");
 		return NULL;
 	}
-	for (i = 0; i < sizeof(tx->preamble) / sizeof(tx->preamble[0]); i++) {
-		tx->preamble[i] = CW_PREAMBLE;
-	}
+	STATS_ALLOC(STAGE_SETUP);
+	tx->preamble_len = PREAMBLE_LEN;
+	tx->n_batches = 1;
+	tx->baud_rate = 0;
+	tx->inv = 0;
+	tx->start_ms = 0;
+	tx->next = NULL;
 	tx->first = tx->last = create_batch();
 	tx->cur_idx = tx->isEOL = 0;
 	tx->cur_btch = NULL;
 	if (tx->first == NULL) {
 		free(tx);
 		tx = NULL;
+	} else {
+		STATS_ALLOC(STAGE_SETUP);
 	}
 	return tx;
 }
 
+// frees a single segment with its batches, the next segment is left alone
+void free_tx(POCSAG_tx *p_tx) {
+	POCSAG_batch *btch, *next;
+	if (p_tx == NULL) return;
+	for (btch = p_tx->first; btch != NULL; btch = next) {
+		next = btch->next;
+		free(btch);
+	}
+	free(p_tx);
+}
+
 uint32_t make_csum(uint32_t dw) {
 	uint32_t p;
+	STATS_START(t0);
 	dw = pocsag_bch(dw);
+	STATS_STOP(STAGE_BCH, t0, 0, 0);
 	p = dw;
 	p ^= p >> 16;	p ^= p >> 8; p ^= p >> 4;
 	p &= 0xF;
@@ -57,19 +77,26 @@ uint32_t make_csum(uint32_t dw) {
 	return dw;
 }
 
+// address codeword of a capcode, it's sent in frame (capcode & 7)
+uint32_t address_cw(uint32_t capcode, uint32_t func) {
+	uint32_t cw_capcode;
+	cw_capcode = capcode >> 3;
+	cw_capcode <<= 13;
+	func &= 3;
+	cw_capcode |= func << 11;
+	cw_capcode &= 0x7FFFF800;
+	return make_csum(cw_capcode);
+}
+
 int add_message(POCSAG_tx *p_tx,uint32_t capcode,uint32_t func,uint8_t *msg, int isNum ) {
 	int frame,cw_bit;
 	int i;
 	uint32_t cw_capcode,cw_mask;
 	POCSAG_batch *cur_btch;
+	STATS_START(t0);
 
 	frame = ((capcode & 7) * 2)+1;
-	cw_capcode = capcode >> 3;
-	cw_capcode <<= 13;
-	func &= 3;
-	cw_capcode |= func << 11;
-	cw_capcode &= 0x7FFFF800;
-	cw_capcode=make_csum(cw_capcode);
+	cw_capcode = address_cw(capcode, func);
 	cur_btch = p_tx->last;
 	cur_btch->data[frame]=cw_capcode;
 
@@ -104,6 +131,8 @@ int add_message(POCSAG_tx *p_tx,uint32_t capcode,uint32_t func,uint8_t *msg, int
 				if (++frame == sizeof(cur_btch->data) / sizeof(cur_btch->data[0])) {
 					POCSAG_batch *new_btch = create_batch();
 					if (new_btch == NULL) return (-1);
+					STATS_ALLOC(STAGE_ADD_MESSAGE);
+					p_tx->n_batches++;
 					p_tx->last = cur_btch->next = new_btch;
 					cur_btch = new_btch;
 					frame = 1;
@@ -125,33 +154,64 @@ int add_message(POCSAG_tx *p_tx,uint32_t capcode,uint32_t func,uint8_t *msg, int
 	}
 	if( cw_bit ) cur_btch->data[frame] = make_csum(cur_btch->data[frame]);
 	cur_btch->next = p_tx->last = create_batch();
+	if (p_tx->last == NULL) return (-1);
+	STATS_ALLOC(STAGE_ADD_MESSAGE);
+	p_tx->n_batches++;
+	STATS_STOP(STAGE_ADD_MESSAGE, t0, 0, 0);
 
 	return 0;
 }
 
+// number of message codewords add_message() uses for the message
+uint32_t message_cws(uint8_t *msg, int isNum) {
+	uint32_t bits = 0;
+	int i;
+	for (i = 0; msg[i]; i++) {
+		if (!isNum) {
+			bits += 7;
+		} else if ((msg[i] >= '0' && msg[i] <= '9') || strchr("U -)(", msg[i]) != NULL) {
+			bits += 4;
+		}
+	}
+	// the first message codeword is always present even if there's nothing to put in it
+	return bits ? (bits + 19) / 20 : 1;
+}
+
+// number of batches add_message() appends to a transmission, including the new empty last batch
+uint32_t message_batches(uint32_t capcode, uint8_t *msg, int isNum) {
+	uint32_t frame = ((capcode & 7) * 2) + 1;
+	return (frame + message_cws(msg, isNum) - 1) / 16 + 1;
+}
+
+// number of bits get_cws() returns for the whole transmission
+uint64_t tx_bits(POCSAG_tx *p_tx) {
+	return ((uint64_t)p_tx->preamble_len + (uint64_t)p_tx->n_batches * 17) * 32;
+}
+
 uint32_t get_cws(POCSAG_tx *p_tx, uint32_t *buf, uint32_t len) {
 	uint32_t ret_len = 0;
 	if (p_tx->isEOL) return 0;
 	
 	for (; len >= 4; len -= 4,buf++) {
 		if (p_tx->cur_btch == NULL) {
-			buf[0] = p_tx->preamble[p_tx->cur_idx++];
-			ret_len += 4;
-			if (p_tx->cur_idx == (sizeof(p_tx->preamble) / sizeof(p_tx->preamble[0]))) {
-				p_tx->cur_idx = 0;
-				p_tx->cur_btch = p_tx->first;
+			if (p_tx->cur_idx < p_tx->preamble_len) {
+				buf[0] = CW_PREAMBLE;
+				p_tx->cur_idx++;
+				ret_len += 4;
+				continue;
 			}
-		} else {
-			buf[0] = p_tx->cur_btch->data[p_tx->cur_idx++];
-			ret_len += 4;
-			if (p_tx->cur_idx == sizeof(p_tx->cur_btch->data) / sizeof(p_tx->cur_btch->data[0])) {
-				p_tx->cur_idx = 0;
-				p_tx->cur_btch = p_tx->cur_btch->next;
-				if (p_tx->cur_btch == NULL) {
-					p_tx->isEOL = 1;
-				}
+			p_tx->cur_idx = 0;
+			p_tx->cur_btch = p_tx->first;
+		}
+		buf[0] = p_tx->cur_btch->data[p_tx->cur_idx++];
+		ret_len += 4;
+		if (p_tx->cur_idx == sizeof(p_tx->cur_btch->data) / sizeof(p_tx->cur_btch->data[0])) {
+			p_tx->cur_idx = 0;
+			p_tx->cur_btch = p_tx->cur_btch->next;
+			if (p_tx->cur_btch == NULL) {
+				p_tx->isEOL = 1;
+				break;
 			}
-
 		}
 	}
 	return ret_len;
@@ -16,12 +16,21 @@ For any other purposes please contact me at e-mail above or any other e-mail lis
 
 #ifdef WIN32
 #include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
 #endif // WIN32
 
 
 #include "pocsag2sdr.h"
 #include "fsk.h"
+#include "writer.h"
 #include "serial.h"
+#include "uart.h"
+#include "wav.h"
+#include "pocsag_sched.h"
+#include "pocsag_sweep.h"
+#include "airtime.h"
+#include "stats.h"
 #include "code_tables.h"
 
 static void usage(void) {
@@ -32,24 +41,68 @@ This program creates I/Q files suitable to transmit with SDR utlities like hackr
 It can also send POCSAG frames via COM port using DTR for signal and RTS for PTT\n\
 \n\
 Usage: pocsag2sdr [options...] <cap code> <func> <message>\n\
+       pocsag2sdr render [options...] <codeword stream file>\n\
+       pocsag2sdr sweep [options...] <first cap code> <last cap code> <func>\n\
 Options:\n\
--s <sample rate>: sample rate in samples per second, 8000000 by default; consult your SDR docs for the optimal values\n\
+-s <sample rate>: sample rate in samples per second, 8000000 by default or 48000 for audio; consult your SDR docs for the optimal values\n\
 -r <POCSAG baud rate>: common values are 512, 1200 and 2400; though actually can be any integer. Default value is 1200\n\
 -d <deviation>: frequency deviation; 4500 by default\n\
--a <amplitude>: maximum amplitude for I/Q components; 64 by default\n\
+-a <amplitude>: maximum amplitude for I/Q components, 64 by default, or for audio samples, 16384 by default\n\
 -w <output file>: output file name; by default automatically generated. If starts with '\\\\.\\', then it's treated as COM port name\n\
+-f <format>: output file format: 'iq' for SDR I/Q samples (default), 'cw' for a compact codeword stream to be rendered later,\n\
+   'wav' or 'pcm' for 16 bit mono baseband audio for transmitters with FSK data input, as WAV file or raw samples\n\
+--lpf <Hz> : low-pass filter cut-off for audio output, e.g. 2000 for 1200 bps; no filtering by default\n\
 -t <delay> : PTT delay in milliseconds in case of COM port encoder mode\n\
 -c <code_tables> : code table for message recoding\n\
+-m <description file> : send pages listed in the transmission description file instead of a single message;\n\
+   the file may have several segments with different baud rates rendered back to back into one stream\n\
+-q <queue file> : send queued pages in order of priority and deadline; each line of the file is\n\
+   <arrival ms> <priority> <deadline ms> <cap code> <func> <message>, higher priority is sent first,\n\
+   deadline is counted from arrival, 0 means no deadline. I/Q and audio files keep the schedule with silence between\n\
+   transmissions, codeword stream and UART files hold them back to back\n\
+--dedup <msecs> : suppress a queued page identical to one which arrived no more than <msecs> earlier; if that one\n\
+   is still queued, it takes the higher priority and earlier deadline of the two. Turned off by default\n\
+--dedup-size <number> : number of entries in the index of recent pages used by '--dedup'; 1024 by default\n\
+--max-batches <number> : maximum number of batches in one transmission of queued pages; unlimited by default\n\
+--max-key <msecs> : maximum keyed time of one transmission of queued pages, including PTT delay; unlimited by default.\n\
+   In COM port mode queued pages are sent back to back after a single preamble while PTT is kept on\n\
+--uart <baud> : send the signal on TXD at the given oversampled UART baud rate, e.g. 115200, instead of toggling DTR;\n\
+   if the output isn't a COM port, the UART bytes are written to the file\n\
+--start <unix time> : send the first bit edge at the given time in seconds since 1970-01-01 UTC, e.g. 1760870400.25;\n\
+   in queue mode it's the time the schedule starts at. For file output the time the file starts playing has to be given\n\
+--file-start <unix time> : the time the first sample of the output file is played, leading silence is inserted up to '--start'\n\
+--loop : pad the I/Q output to be looped seamlessly, e.g. with hackrf_transfer -R: it ends on a bit boundary\n\
+   after a whole number of carrier cycles\n\
+--gap <msecs> : silence at the end of the loop, stretched to keep the carrier phase; 0 by default\n\
+--loop-tol <degrees> : carrier phase error allowed at the loop point without a gap; 0 by default\n\
+--duty <percent> : keep the keyed time of queued transmissions under <percent> of any rolling window by delaying them;\n\
+   the utilisation is reported even without a limit\n\
+--duty-window <secs> : duty cycle window; 3600 by default. '--duty', '--duty-window' and '--dedup' need '-q', the limit\n\
+   is kept in COM port, I/Q and audio output only\n\
+--dry-run : count bits, airtime, samples and output bytes without rendering or sending anything;\n\
+   loop padding isn't included\n\
 -i : turn on signal inversion; turned off by default\n\
 -n : send the message in numeric fortmat; otherwise it'll be sent as alpha-numeric\n\
 -v <number>: turn on verbose mode with the optional level <number>\n\
 -x : change DTR and RTS, i.e. use RTS for signal and DTR for PTT\n\
 -y : inverse PTT, i.e. use low level to key a transceiver\n\
+--buffers <number> : number of output buffers shared between the renderer and the writer thread; 4 by default\n\
+--buffer-size <bytes> : size of one output buffer; 1048576 by default\n\
+--direct : write the output file unbuffered, bypassing the OS file cache; useful for very large outputs\n\
+--stats : print per-stage run statistics as JSON (also printed in verbose mode); requires build with POCSAG_STATS\n\
 \n\
 Destination parameters:\n\
 <cap code> : pager CAP code\n\
 <func> : function code; valid values from 0 to 3\n\
 <message> : alphanumeric message; numeric messages aren't currently supported\n\
+\n\
+The 'render' command turns a codeword stream file written with '-f cw' into I/Q samples or sends it via COM port;\n\
+baud rate and polarity are taken from the file, '-i' inverts the stored polarity. Use '-' to read the file from stdin\n\
+and '-w -' to write I/Q samples to stdout\n\
+\n\
+The 'sweep' command sends tone-only address codewords of every cap code in the range, 16 per batch after a single\n\
+preamble, to find the cap code of an unknown pager. The time offset of every cap code is written to the index file\n\
+<output file>.idx, or the one given with '--index <file>'\n\
 ");
 	printf("\nSupported code tables: ");
 	for (ptbl = code_tables; ptbl->name != NULL; ptbl++) {
@@ -58,6 +111,15 @@ Destination parameters:\n\
 	printf("\n");
 }
 
+enum {
+	FMT_IQ=0,
+	FMT_CW,
+	FMT_WAV,
+	FMT_PCM
+};
+
+static char *formats[] = { "iq", "cw", "wav", "pcm", NULL };
+
 char *optarg = NULL;
 int optind = 1;
 
@@ -67,6 +129,13 @@ static int getopt(int argc, char *argv[], char *sw)
 	if (optind >= argc) return (-1);
 	if (argv[optind][0] != '-' && argv[optind][0] != '/') return (-1);
 	sym = argv[optind][1];
+	if (sym == 0) return (-1);	// lone '-' stands for stdin/stdout
+	if (sym == '-') {
+		// long option, its name is returned in optarg
+		optarg = argv[optind] + 2;
+		optind++;
+		return sym;
+	}
 	s = strchr(sw, sym);
 	optind++;
 	if (s == NULL || *s == 0) {
@@ -84,32 +153,292 @@ static int getopt(int argc, char *argv[], char *sw)
 	return sym;
 }
 
+static char *long_optarg(int argc, char *argv[])
+{
+	if (optind >= argc) return NULL;
+	return argv[optind++];
+}
+
+static void no_long_optarg(char *name, char *oarg) {
+	if (oarg != NULL) return;
+	fprintf(stderr, "No optional argument for option '--%s'\n", name);
+	exit(1);
+}
+
+// argument of the long option in optarg, exits if there isn't one
+static char *long_arg(int argc, char *argv[]) {
+	char *name = optarg;
+	char *oarg = long_optarg(argc, argv);
+	no_long_optarg(name, oarg);
+	return oarg;
+}
+
 static void no_optarg(int opt, unsigned char *oarg ) {
 	if (oarg != NULL) return;
 	fprintf(stderr, "No optional argument for option '%c'\n", (unsigned char)opt);
 	exit(1);
 }
 
+// parses <seconds>[.<fraction>] since 1970-01-01 UTC into nanoseconds
+static int parse_epoch(char *s, int64_t *ns) {
+	int64_t secs = 0, frac = 0, scale = 1000000000;
+	if (*s < '0' || *s > '9') return (-1);
+	for (; *s >= '0' && *s <= '9'; s++) secs = secs * 10 + (*s - '0');
+	if (*s == '.') {
+		for (s++; *s >= '0' && *s <= '9'; s++) {
+			if (scale > 1) {
+				scale /= 10;
+				frac += (*s - '0') * scale;
+			}
+		}
+	}
+	if (*s != 0) return (-1);
+	*ns = secs * 1000000000 + frac;
+	return 0;
+}
+
+static uint8_t *recode_msg(PAGER_codetable *p_tbl, uint8_t *msg, int verbose, FILE *log_fp) {
+	uint8_t *recoded_msg = malloc(strlen(msg) + 1);
+	int i;
+	STATS_START(t0);
+	if (recoded_msg == NULL) {
+		set_error(ERR_ERRNO, "Can't allocate memory for recoded message");
+		return NULL;
+	}
+	STATS_ALLOC(STAGE_RECODE);
+	for (i = 0; msg[i]; i++) {
+		recoded_msg[i] = p_tbl->table[msg[i]];
+	}
+	recoded_msg[i] = 0;
+	STATS_STOP(STAGE_RECODE, t0, i, 0);
+	if (verbose) {
+		fprintf(log_fp, "Original message: '%s'\n Recoded message: '%s'\n", msg, recoded_msg);
+	}
+	return recoded_msg;
+}
+
+/*
+Transmission description file, one item per line, '#' starts a comment:
+segment <baud rate> [<preamble length in codewords>]
+page <cap code> <func> <alphanumeric message>
+numeric <cap code> <func> <numeric message>
+Every 'segment' line starts a new segment sent with its own baud rate; pages before the first one go
+to a segment with the default baud rate.
+*/
+static SCHED_queue *load_queue(char *fname, int isNum, PAGER_codetable *p_tbl, int verbose, FILE *log_fp) {
+	FILE *fp;
+	char line[1024];
+	SCHED_queue *q;
+	int line_no = 0, err = 0;
+
+	q = create_sched();
+	if (q == NULL) return NULL;
+	fp = fopen(fname, "r");
+	if (fp == NULL) {
+		set_error(ERR_ERRNO, "Can't open queue file '%s'", fname);
+		free_sched(q);
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *p = line + strlen(line);
+		unsigned long arrival, deadline, capcode, func;
+		uint8_t *msg;
+		int priority, n = 0;
+
+		line_no++;
+		if (p == line + sizeof(line) - 1 && p[-1] != '\n' && !feof(fp)) {
+			set_error(ERR_MSG, "%s:%d: line is longer than %d characters", fname, line_no, (int)sizeof(line) - 2);
+			err = 1;
+			break;
+		}
+		while (p > line && (p[-1] == '\n' || p[-1] == '\r')) *--p = 0;
+		for (p = line; *p == ' ' || *p == '\t'; p++);
+		if (*p == 0 || *p == '#') continue;
+		if (sscanf(line, "%lu %d %lu %lu %lu %n", &arrival, &priority, &deadline, &capcode, &func, &n) < 5 || n == 0) {
+			set_error(ERR_MSG, "%s:%d: <arrival ms> <priority> <deadline ms> <cap code> <func> <message> expected", fname, line_no);
+			err = 1;
+			break;
+		}
+		msg = line + n;
+		if (p_tbl != NULL && (msg = recode_msg(p_tbl, msg, verbose, log_fp)) == NULL) {
+			err = 1;
+			break;
+		}
+		if (sched_add(q, capcode, func, msg, isNum, priority, arrival, deadline) == (-1)) err = 1;
+		if ((char *)msg != line + n) free(msg);
+		if (err) break;
+	}
+	if (!err && ferror(fp)) {
+		set_error(ERR_ERRNO, "[fgets] Can't read queue file '%s'", fname);
+		err = 1;
+	}
+	fclose(fp);
+	if (err) {
+		free_sched(q);
+		return NULL;
+	}
+	return q;
+}
+
+static POCSAG_tx *load_description(char *fname, uint32_t baud_rate, int inv, int isNum, PAGER_codetable *p_tbl, int verbose, FILE *log_fp) {
+	FILE *fp;
+	char line[1024], cmd[16];
+	POCSAG_tx *first = NULL, *seg = NULL;
+	int line_no = 0, err = 0;
+
+	fp = fopen(fname, "r");
+	if (fp == NULL) {
+		set_error(ERR_ERRNO, "Can't open transmission description '%s'", fname);
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *p = line + strlen(line);
+		unsigned long a1, a2;
+		int n = 0;
+
+		line_no++;
+		if (p == line + sizeof(line) - 1 && p[-1] != '\n' && !feof(fp)) {
+			set_error(ERR_MSG, "%s:%d: line is longer than %d characters", fname, line_no, (int)sizeof(line) - 2);
+			err = 1;
+			break;
+		}
+		while (p > line && (p[-1] == '\n' || p[-1] == '\r')) *--p = 0;
+		if (sscanf(line, "%15s", cmd) != 1 || cmd[0] == '#') continue;
+		if (!strcmp(cmd, "segment") || seg == NULL) {
+			POCSAG_tx *new_seg;
+			a1 = baud_rate; a2 = PREAMBLE_LEN;
+			if (!strcmp(cmd, "segment") && (sscanf(line, "%*s %lu %lu", &a1, &a2) < 1 || a1 == 0)) {
+				set_error(ERR_MSG, "%s:%d: segment <baud rate> [<preamble length>] expected", fname, line_no);
+				err = 1;
+				break;
+			}
+			if (a2 > CW_MAX_PREAMBLE) {
+				set_error(ERR_MSG, "%s:%d: preamble length %lu is over %lu codewords", fname, line_no, a2, (unsigned long)CW_MAX_PREAMBLE);
+				err = 1;
+				break;
+			}
+			new_seg = create_preamble();
+			if (new_seg == NULL) {
+				err = 1;
+				break;
+			}
+			new_seg->baud_rate = a1;
+			new_seg->preamble_len = a2;
+			new_seg->inv = inv;
+			if (seg == NULL) {
+				first = new_seg;
+			} else {
+				seg->next = new_seg;
+			}
+			seg = new_seg;
+			if (!strcmp(cmd, "segment")) continue;
+		}
+		if (!strcmp(cmd, "page") || !strcmp(cmd, "numeric")) {
+			uint8_t *msg;
+			if (sscanf(line, "%*s %lu %lu %n", &a1, &a2, &n) < 2 || n == 0) {
+				set_error(ERR_MSG, "%s:%d: %s <cap code> <func> <message> expected", fname, line_no, cmd);
+				err = 1;
+				break;
+			}
+			msg = line + n;
+			if ((p_tbl != NULL && (msg = recode_msg(p_tbl, msg, verbose, log_fp)) == NULL) ||
+				add_message(seg, a1, a2 & 3, msg, isNum || !strcmp(cmd, "numeric")) == (-1)) {
+				err = 1;
+				break;
+			}
+			if ((char *)msg != line + n) free(msg);
+		} else {
+			set_error(ERR_MSG, "%s:%d: unknown keyword '%s'", fname, line_no, cmd);
+			err = 1;
+			break;
+		}
+	}
+	if (!err && ferror(fp)) {
+		set_error(ERR_ERRNO, "[fgets] Can't read transmission description '%s'", fname);
+		err = 1;
+	}
+	fclose(fp);
+	if (err) return NULL;
+	if (first == NULL) {
+		set_error(ERR_MSG, "Transmission description '%s' is empty", fname);
+		return NULL;
+	}
+	return first;
+}
+
+static void print_uart_stats(FILE *log_fp) {
+	UART_params *uart_p = get_uart_params();
+	double us_per_uart_bit = 1e6 / (double)uart_p->uart_baud;
+	double mean = 0, jitter = 0;
+	if (uart_p->edges) {
+		mean = uart_p->edge_err_sum / (double)uart_p->edges;
+		jitter = sqrt(fmax(uart_p->edge_err_sq_sum / (double)uart_p->edges - mean * mean, 0));
+	}
+	fprintf(log_fp, "UART encoder: %lld bits in %lld characters at %ld baud, %lf UART bits per bit\n",
+		uart_p->total_bits_sent, uart_p->uart_bits / UART_CHAR_BITS, uart_p->uart_baud, (double)uart_p->uart_baud / (double)uart_p->bit_rate);
+	fprintf(log_fp, "Start/stop bit glitches: %lld of %lld UART bits (%.2lf%%), %.2lf usecs each\n",
+		uart_p->forced_bits, uart_p->uart_bits, uart_p->uart_bits ? 100.0 * (double)uart_p->forced_bits / (double)uart_p->uart_bits : 0.0, us_per_uart_bit);
+	if (uart_p->edges) {
+		fprintf(log_fp, "Edge timing error over %lld edges: mean %+.2lf usecs, jitter %.2lf usecs rms, %.2lf usecs peak-to-peak\n",
+			uart_p->edges, mean * us_per_uart_bit, jitter * us_per_uart_bit, (uart_p->edge_err_max - uart_p->edge_err_min) * us_per_uart_bit);
+	}
+	STATS_COUNTER("uart_glitches", uart_p->forced_bits);
+	STATS_COUNTER("uart_edge_error_usecs", mean * us_per_uart_bit);
+	STATS_COUNTER("uart_edge_jitter_usecs", jitter * us_per_uart_bit);
+}
+
 int main( int argc, char *argv[] )
 {
-	uint32_t sample_rate = 8000000ul;
+	uint32_t sample_rate = 0;	// default depends on the output format
 	uint32_t baud_rate = 1200;
 	uint32_t dev = 4500;
-	uint32_t amplitude = 0x40;
+	uint32_t amplitude = 0;
 	uint8_t *ofile = NULL;
 	uint8_t ofile_name[_MAX_PATH + 1];
-	int inv = 0, PTTinv = 0, DtrRtsX = 0, KeepPTT = 0, isNum = 0, verbose = 0;
+	int inv = 0, PTTinv = 0, DtrRtsX = 0, KeepPTT = 0, isNum = 0, verbose = 0, show_stats = 0;
+	uint32_t buf_size = WRITER_BUF_SIZE;
+	int n_bufs = WRITER_N_BUFS, direct = 0;
+	int format = FMT_IQ, isRender = 0, isSweep = 0;
+	SWEEP_params *sw = NULL;
+	uint8_t sweep_name[_MAX_PATH + 1], idx_name[_MAX_PATH + 1];
+	uint8_t *idx_file = NULL;
+	FILE *idx_fp = NULL;
+	uint8_t *ifile = NULL, *dfile = NULL, *qfile = NULL;
+	SCHED_queue *q = NULL;
+	uint32_t max_batches = 0, max_key_ms = 0;
+	uint32_t dedup_ms = 0, dedup_size = SCHED_DUP_SIZE;
+	double duty_pct = 0;
+	uint32_t duty_window_ms = SCHED_DUTY_WINDOW;
+	char *queue_opt = NULL;
+	int dry_run = 0;
+	uint32_t uart_baud = 0, lpf = 0;
+	int loop = 0;
+	uint32_t gap_ms = 0;
+	double loop_tol = 0;
+	int64_t start_ns = 0, file_start_ns = 0, start_ts = 0;
+	int (*output_bit)(int bit) = fsk_output_bit;
+	int (*set_bit_rate)(uint32_t bps) = fsk_set_bit_rate;
+	int (*start_offset)(double offset) = fsk_start_offset;
+	double lead = 0;
+	int timed = 0;
+	FILE *ifp = NULL, *ofp = NULL, *log_fp = stdout;
 
-	POCSAG_tx *p_tx;
+	POCSAG_tx *p_tx = NULL, *seg;
 	PAGER_codetable *p_tbl=NULL;
 	uint32_t cap_code, func;
 	uint8_t *msg;
 
-	FILE *ofp;
-
 	int rc,isSerial=0,PTTdelay=0;
 
-	while ((rc = getopt(argc, argv, "inxyzv:t:s:r:d:a:w:c:")) != (-1)) {
+	if (argc > 1 && !strcmp(argv[1], "render")) {
+		isRender = 1;
+		argc--; argv++;
+	} else if (argc > 1 && !strcmp(argv[1], "sweep")) {
+		isSweep = 1;
+		argc--; argv++;
+	}
+
+	while ((rc = getopt(argc, argv, "inxyzv:t:s:r:d:a:w:c:f:m:q:")) != (-1)) {
 		switch (rc) {
 		case 'i': inv = 1;	break;
 		case 'n': isNum = 1;	break;
@@ -131,6 +460,93 @@ int main( int argc, char *argv[] )
 			amplitude = atoi(optarg); break;
 		case 'w': no_optarg(rc, optarg);
 			ofile = optarg; break;
+		case 'm': no_optarg(rc, optarg);
+			dfile = optarg; break;
+		case 'q': no_optarg(rc, optarg);
+			qfile = optarg; break;
+		case 'f': no_optarg(rc, optarg);
+			for (format = 0; formats[format] != NULL; format++) {
+				if (!strcmp(formats[format], optarg)) break;
+			}
+			if (formats[format] == NULL) {
+				fprintf(stderr, "Unsupported output format: %s\n", optarg);
+				usage();
+				return 1;
+			}
+			break;
+		case '-':
+			if (!strcmp(optarg, "stats")) {
+				show_stats = 1;
+			} else if (!strcmp(optarg, "direct")) {
+				direct = 1;
+			} else if (!strcmp(optarg, "buffers")) {
+				optarg = long_arg(argc, argv);
+				n_bufs = atoi(optarg);
+			} else if (!strcmp(optarg, "max-batches")) {
+				optarg = long_arg(argc, argv);
+				max_batches = atoi(optarg);
+			} else if (!strcmp(optarg, "max-key")) {
+				optarg = long_arg(argc, argv);
+				max_key_ms = atoi(optarg);
+			} else if (!strcmp(optarg, "dry-run")) {
+				dry_run = 1;
+			} else if (!strcmp(optarg, "duty")) {
+				queue_opt = optarg;
+				optarg = long_arg(argc, argv);
+				duty_pct = atof(optarg);
+			} else if (!strcmp(optarg, "duty-window")) {
+				char *end;
+				double secs;
+				queue_opt = optarg;
+				optarg = long_arg(argc, argv);
+				secs = strtod(optarg, &end);
+				// checked before the cast, a negative or huge window would wrap around
+				if (end == optarg || *end != '\0' || !(secs > 0) || secs > (double)UINT32_MAX / 1000) {
+					fprintf(stderr, "Invalid duty cycle window: %s\n", optarg);
+					return 1;
+				}
+				duty_window_ms = (uint32_t)(secs * 1000);
+			} else if (!strcmp(optarg, "dedup")) {
+				queue_opt = optarg;
+				optarg = long_arg(argc, argv);
+				dedup_ms = atoi(optarg);
+			} else if (!strcmp(optarg, "dedup-size")) {
+				queue_opt = optarg;
+				optarg = long_arg(argc, argv);
+				dedup_size = atoi(optarg);
+			} else if (!strcmp(optarg, "start") || !strcmp(optarg, "file-start")) {
+				char *name = optarg;
+				optarg = long_arg(argc, argv);
+				if (parse_epoch(optarg, !strcmp(name, "start") ? &start_ns : &file_start_ns) == (-1)) {
+					fprintf(stderr, "Invalid time for option '--%s': %s\n", name, optarg);
+					return 1;
+				}
+			} else if (!strcmp(optarg, "loop")) {
+				loop = 1;
+			} else if (!strcmp(optarg, "gap")) {
+				optarg = long_arg(argc, argv);
+				gap_ms = atoi(optarg);
+			} else if (!strcmp(optarg, "loop-tol")) {
+				optarg = long_arg(argc, argv);
+				loop_tol = atof(optarg);
+			} else if (!strcmp(optarg, "index")) {
+				optarg = long_arg(argc, argv);
+				idx_file = optarg;
+			} else if (!strcmp(optarg, "lpf")) {
+				optarg = long_arg(argc, argv);
+				lpf = atoi(optarg);
+			} else if (!strcmp(optarg, "uart")) {
+				optarg = long_arg(argc, argv);
+				uart_baud = atoi(optarg);
+			} else if (!strcmp(optarg, "buffer-size")) {
+				optarg = long_arg(argc, argv);
+				buf_size = atoi(optarg);
+			} else {
+				fprintf(stderr, "Unknown option: '--%s'\n", optarg);
+				usage();
+				return 1;
+			}
+			break;
 		case 'c': no_optarg(rc, optarg);
 			for (p_tbl = code_tables; p_tbl->name != NULL; p_tbl++) {
 				if (!strcmp(p_tbl->name, optarg)) break;
@@ -149,107 +565,617 @@ int main( int argc, char *argv[] )
 	}
 
 	argc -= optind; argv += optind;
-	if ( argc<3 && !KeepPTT ) {
-		fprintf(stderr, "No destination specified\n");
-		usage();
+	if (sample_rate == 0) sample_rate = (format == FMT_WAV || format == FMT_PCM) ? WAV_SAMPLE_RATE : 8000000ul;
+	if (amplitude == 0) amplitude = (format == FMT_WAV || format == FMT_PCM) ? WAV_AMPLITUDE : 0x40;
+	if (ofile != NULL && !strcmp(ofile, "-")) {
+		// output data go to stdout, so keep it clean of messages
+		log_fp = stderr;
+	}
+	if (ofile != NULL && (!strncmp(ofile, "com", 3) || !strncmp(ofile, "\\\\.\\", 4))) {
+		isSerial = 1;
+	}
+	if (queue_opt != NULL && qfile == NULL) {
+		fprintf(stderr, "Option '--%s' can only be used with a queue file\n", queue_opt);
 		return 1;
 	}
-	cap_code = atoi(argv[0]);
-	func = atoi(argv[1]) & 3;
-	msg = argv[2];
-	if (ofile) {
-		if (!strncmp(ofile, "com", 3) || !strncmp(ofile,"\\\\.\\",4) ) {
-			isSerial = 1;
+	if (duty_pct != 0 && !isSerial && (format == FMT_CW || uart_baud)) {
+		// the transmissions are written back to back, the delays wouldn't be kept
+		fprintf(stderr, "Duty cycle limit can't be used with %s output\n", uart_baud ? "UART" : formats[format]);
+		return 1;
+	}
+	if (isRender) {
+		POCSAG_tx *last = NULL;
+		if (argc < 1) {
+			fprintf(stderr, "No codeword stream file specified\n");
+			usage();
+			return 1;
+		}
+		if (format == FMT_CW) {
+			fprintf(stderr, "Codeword stream can't be rendered to codeword stream\n");
+			return 1;
+		}
+		ifile = argv[0];
+		if (!strcmp(ifile, "-")) {
+			ifp = stdin;
+			_setmode(_fileno(stdin), _O_BINARY);
 		} else {
+			ifp = fopen(ifile, "rb");
+			if (ifp == NULL) {
+				fprintf(stderr, "Can't open codeword stream file '%s': %s\n", ifile, strerror(errno));
+				return 1;
+			}
+		}
+		if (read_cw_header(ifp) == (-1)) {
+			fprintf(stderr, "[read_cw_header]%s\n", my_strerror());
+			return 1;
+		}
+		while ((rc = read_cw_segment(ifp, &seg)) == 1) {
+			seg->inv ^= inv;
+			if (last == NULL) {
+				p_tx = seg;
+			} else {
+				last->next = seg;
+			}
+			last = seg;
+		}
+		if (rc == (-1)) {
+			fprintf(stderr, "[read_cw_segment]%s\n", my_strerror());
+			return 1;
+		}
+		if (p_tx == NULL) {
+			fprintf(stderr, "Codeword stream file '%s' is empty\n", ifile);
+			return 1;
+		}
+		if (ifp != stdin) fclose(ifp);
+		baud_rate = p_tx->baud_rate;
+	} else if (dfile != NULL) {
+		p_tx = load_description(dfile, baud_rate, inv, isNum, p_tbl, verbose, log_fp);
+		if (p_tx == NULL) {
+			fprintf(stderr, "[load_description]%s\n", my_strerror());
+			return 1;
+		}
+		baud_rate = p_tx->baud_rate;
+	} else if (qfile != NULL) {
+		POCSAG_tx *last = NULL;
+		uint64_t now_ms = 0;
+		q = load_queue(qfile, isNum, p_tbl, verbose, log_fp);
+		if (q == NULL) {
+			fprintf(stderr, "[load_queue]%s\n", my_strerror());
+			return 1;
+		}
+		if (isSerial) q->tx_overhead_ms = PTTdelay;
+		if (sched_set_dedup(q, dedup_ms, dedup_size) == (-1)) {
+			fprintf(stderr, "[sched_set_dedup]%s\n", my_strerror());
+			return 1;
+		}
+		// utilisation is tracked even without a limit
+		if (sched_set_duty(q, duty_pct, duty_window_ms) == (-1)) {
+			fprintf(stderr, "[sched_set_duty]%s\n", my_strerror());
+			return 1;
+		}
+		if (max_key_ms != 0) {
+			// batches which fit into the keyed time after PTT delay and preamble
+			int64_t key_bits = ((int64_t)max_key_ms - (isSerial ? PTTdelay : 0)) * baud_rate / 1000;
+			int64_t key_batches = (key_bits / 32 - PREAMBLE_LEN) / 17;
+			if (key_batches < 2) {
+				fprintf(stderr, "Maximum keyed time %ld msecs is too short for a single page at %ld bps\n", max_key_ms, baud_rate);
+				return 1;
+			}
+			if (max_batches == 0 || key_batches < max_batches) max_batches = (uint32_t)key_batches;
+		}
+		// every transmission is a segment of its own with a preamble
+		while ((rc = sched_next_tx(q, &now_ms, baud_rate, inv, max_batches, &seg)) == 1) {
+			if (last == NULL) {
+				p_tx = seg;
+			} else {
+				last->next = seg;
+			}
+			last = seg;
+		}
+		if (rc == (-1)) {
+			fprintf(stderr, "[sched_next_tx]%s\n", my_strerror());
+			return 1;
+		}
+		if (p_tx == NULL) {
+			fprintf(stderr, "Queue file '%s' is empty\n", qfile);
+			return 1;
+		}
+		fprintf(log_fp, "Queue: %ld pages in %ld transmissions, %ld deadline misses, %lf seconds of schedule\n",
+			q->pages_sent, q->transmissions, q->deadline_misses, (double)now_ms / 1000.0);
+		STATS_COUNTER("queue_pages", q->pages_sent);
+		STATS_COUNTER("queue_transmissions", q->transmissions);
+		STATS_COUNTER("queue_deadline_misses", q->deadline_misses);
+		if (q->size_overruns) {
+			fprintf(log_fp, "*** WARNING *** %ld pages are longer than %s and have been sent anyway\n",
+				q->size_overruns, max_key_ms ? "the maximum keyed time" : "the maximum number of batches");
+		}
+		STATS_COUNTER("queue_size_overruns", q->size_overruns);
+		if (dedup_ms != 0) {
+			// saved codewords are counted at the queue baud rate, batch padding isn't included
+			double saved_secs = (double)q->dup_bits_saved / (double)baud_rate;
+			fprintf(log_fp, "Duplicates: %ld suppressed (%ld merged into queued pages, %ld dropped), %lf seconds of airtime saved\n",
+				q->dups_merged + q->dups_dropped, q->dups_merged, q->dups_dropped, saved_secs);
+			STATS_COUNTER("queue_duplicates", q->dups_merged + q->dups_dropped);
+			STATS_COUNTER("queue_duplicates_merged", q->dups_merged);
+			STATS_COUNTER("queue_airtime_saved_seconds", saved_secs);
+		}
+		fprintf(log_fp, "Duty cycle: %.2lf%% peak and %.2lf%% in the last %lf seconds window, %.2lf%% over the whole schedule\n",
+			q->duty_peak, sched_duty(q, now_ms), (double)q->duty_window_ms / 1000.0, now_ms ? 100.0 * (double)q->keyed_ms / (double)now_ms : 0.0);
+		if (q->duty_pct != 0) {
+			fprintf(log_fp, "Duty cycle limit %.2lf%%: %ld transmissions delayed by %lf seconds in total\n",
+				q->duty_pct, q->duty_delays, (double)q->duty_delay_ms / 1000.0);
+			if (q->duty_overruns) {
+				fprintf(log_fp, "*** WARNING *** %ld transmissions are longer than the duty cycle budget of a window\n", q->duty_overruns);
+			}
+		}
+		STATS_COUNTER("duty_peak_percent", q->duty_peak);
+		STATS_COUNTER("duty_delays", q->duty_delays);
+		STATS_COUNTER("duty_delay_seconds", (double)q->duty_delay_ms / 1000.0);
+	} else if (isSweep) {
+		if (argc < 3) {
+			fprintf(stderr, "No capcode range specified\n");
+			usage();
+			return 1;
+		}
+		sw = create_sweep(atoi(argv[0]), atoi(argv[1]), atoi(argv[2]));
+		if (sw == NULL) {
+			fprintf(stderr, "[create_sweep]%s\n", my_strerror());
+			return 1;
+		}
+		snprintf(sweep_name, _MAX_PATH, "POCSAG_sweep_%ld_%ld_%ld", sw->first, sw->last, sw->func);
+		// a single batch is reused for the whole sweep
+		p_tx = create_preamble();
+		if (p_tx == NULL) {
+			fprintf(stderr, "[create_preamble]%s\n", my_strerror());
+			return 1;
+		}
+		p_tx->baud_rate = baud_rate;
+		p_tx->inv = inv;
+		fprintf(log_fp, "Sweep: %ld capcodes in %lld batches, %lf seconds of airtime\n", sw->last - sw->first + 1, sw->n_batches,
+			(double)(p_tx->preamble_len + sw->n_batches * 17) * 32 / (double)baud_rate);
+	} else {
+		if ( argc<3 && !KeepPTT ) {
+			fprintf(stderr, "No destination specified\n");
+			usage();
+			return 1;
+		}
+		if (!KeepPTT) {
+			cap_code = atoi(argv[0]);
+			func = atoi(argv[1]) & 3;
+			msg = argv[2];
+
+			p_tx = create_preamble();
+			if (p_tx == NULL) {
+				fprintf(stderr, "[create_preamble]%s\n", my_strerror());
+				return 1;
+			}
+			p_tx->baud_rate = baud_rate;
+			p_tx->inv = inv;
+			if (p_tbl != NULL && (msg = recode_msg(p_tbl, msg, verbose, log_fp)) == NULL) {
+				fprintf(stderr, "[recode_msg]%s\n", my_strerror());
+				return 1;
+			}
+			if (add_message(p_tx, cap_code, func, msg, isNum) == (-1)) {
+				fprintf(stderr, "[add_message]%s\n", my_strerror());
+				return 1;
+			}
+		}
+	}
+	if (ofile) {
+		if (!isSerial) {
 			strncpy(ofile_name, ofile, _MAX_PATH);
 		}
+	} else if (isRender || dfile != NULL || qfile != NULL || isSweep) {
+		uint8_t *base = isRender ? ifile : dfile != NULL ? dfile : qfile != NULL ? qfile : sweep_name;
+		if (format == FMT_CW) {
+			snprintf(ofile_name, _MAX_PATH, "%s.cw", base);
+		} else if (format == FMT_WAV || format == FMT_PCM) {
+			snprintf(ofile_name, _MAX_PATH, "%s_%ld_%ld%s.%s", strcmp(base, "-") ? (char *)base : "POCSAG", baud_rate, sample_rate, inv ? "_inv" : "", formats[format]);
+		} else {
+			snprintf(ofile_name, _MAX_PATH, "%s_%ld_%ld_%ld%s.bin", strcmp(base, "-") ? (char *)base : "POCSAG", baud_rate, dev, sample_rate, inv ? "_inv" : "");
+		}
+	} else if (format == FMT_CW) {
+		snprintf(ofile_name, _MAX_PATH, "POCSAG_%ld_%ld_%ld%s.cw", cap_code, func, baud_rate, inv ? "_inv" : "");
+	} else if (format == FMT_WAV || format == FMT_PCM) {
+		snprintf(ofile_name, _MAX_PATH, "POCSAG_%ld_%ld_%ld_%ld%s.%s", cap_code, func, baud_rate, sample_rate, inv ? "_inv" : "", formats[format]);
 	} else {
 		snprintf(ofile_name, _MAX_PATH, "POCSAG_%ld_%ld_%ld_%ld_%ld%s.bin",cap_code,func,baud_rate,dev,sample_rate,inv ? "_inv" : "");
 	}
+	if (isSerial && format == FMT_CW) {
+		fprintf(stderr, "Codeword stream can't be sent via COM port, use the 'render' command instead\n");
+		return 1;
+	}
+	if (isSerial && format != FMT_IQ) {
+		fprintf(stderr, "Audio can't be sent via COM port\n");
+		return 1;
+	}
+	if (uart_baud && format != FMT_IQ) {
+		fprintf(stderr, "UART encoder mode can't be used with %s output\n", formats[format]);
+		return 1;
+	}
+	if (loop && (isSerial || uart_baud || format != FMT_IQ || start_ns || q != NULL)) {
+		fprintf(stderr, "Loop output can only be made for I/Q files without start time or queue\n");
+		return 1;
+	}
+	if (start_ns && !isSerial) {
+		if (format == FMT_CW || uart_baud) {
+			fprintf(stderr, "Start time can't be used with %s output\n", uart_baud ? "UART" : formats[format]);
+			return 1;
+		}
+		if (file_start_ns == 0 || file_start_ns > start_ns) {
+			fprintf(stderr, "Output file start time before the start time has to be given with '--file-start'\n");
+			return 1;
+		}
+		lead = (double)(start_ns - file_start_ns) * 1e-9 * (double)sample_rate;
+	}
+	if (q != NULL && !isSerial) {
+		if (format == FMT_CW || uart_baud) {
+			fprintf(log_fp, "*** NOTE *** queued transmissions are written to %s output back to back, their start times aren't kept\n",
+				uart_baud ? "UART" : formats[format]);
+		} else {
+			// the output has the timeline of the schedule, idle time is silence
+			timed = 1;
+		}
+	}
+
+	if (dry_run) {
+		// nothing is opened or rendered, the counts follow the arithmetic of the chosen output
+		AIR_count ac;
+		if (p_tx == NULL) {
+			fprintf(stderr, "Nothing to send\n");
+			return 1;
+		}
+		if (isSweep) p_tx->n_batches = (uint32_t)sw->n_batches;
+		if (format == FMT_CW) {
+			air_count_cw(p_tx, &ac);
+		} else if (uart_baud) {
+			air_count_uart(p_tx, uart_baud, isSerial && q != NULL, &ac);
+		} else if (isSerial) {
+			air_count_bits(p_tx, &ac);
+		} else if (format == FMT_WAV || format == FMT_PCM) {
+			air_count_wav(p_tx, sample_rate, lead, timed, format == FMT_WAV, &ac);
+		} else {
+			air_count_iq(p_tx, sample_rate, start_ns != 0, lead, timed, &ac);
+		}
+		fprintf(log_fp, "Dry run: %ld segments, %lld batches, %lld bits, %lf seconds of airtime\n", ac.segments, ac.batches, ac.bits, ac.seconds);
+		if (isSerial) {
+			uint32_t keyings = q != NULL ? q->transmissions : 1;
+			fprintf(log_fp, "PTT on for %lf seconds in %ld keyings\n", ac.seconds + (double)keyings * PTTdelay / 1000.0, keyings);
+		}
+		if (ac.bytes != 0 && !isSerial) {
+			if (format == FMT_CW) {
+				fprintf(log_fp, "Output: %lld bytes\n", ac.bytes);
+			} else {
+				fprintf(log_fp, "Output: %lld %s, %lld bytes\n", ac.samples, uart_baud ? "UART bit periods" : "samples", ac.bytes);
+			}
+		} else if (uart_baud) {
+			fprintf(log_fp, "UART: %lld bit periods, %lld bytes\n", ac.samples, ac.bytes);
+		}
+		return 0;
+	}
+
+#ifndef POCSAG_STATS
+	if (show_stats) {
+		fprintf(stderr, "*** WARNING *** statistics support isn't compiled in, rebuild with POCSAG_STATS defined\n");
+	}
+#endif // POCSAG_STATS
+	STATS_RUN_INFO(isSerial ? "serial" : uart_baud ? "uart" : formats[format], (isSerial || format == FMT_CW) ? 0 : uart_baud ? uart_baud : sample_rate, baud_rate);
 
-	if (!isSerial) {
-		printf("*** START *** SDR I/Q file generation mode\n");
-		ofp = fopen(ofile_name, "wb");
-		if (ofp == NULL) {
-			fprintf(stderr, "Can't open output file '%s': %s\n", ofile_name, strerror(errno));
+	if (format == FMT_CW) {
+		fprintf(log_fp, "*** START *** codeword stream file generation mode\n");
+		if (!strcmp(ofile_name, "-")) {
+			ofp = stdout;
+			_setmode(_fileno(stdout), _O_BINARY);
+		} else {
+			ofp = fopen(ofile_name, "wb");
+			if (ofp == NULL) {
+				fprintf(stderr, "Can't open output file '%s': %s\n", ofile_name, strerror(errno));
+				return 1;
+			}
+		}
+	} else if (!isSerial && uart_baud) {
+		// UART byte stream as it would be written to TXD, for testing without a COM port
+		fprintf(log_fp, "*** START *** UART TX encoder file generation mode\n");
+		if (init_writer(ofile_name, buf_size, n_bufs, direct) == (-1)) {
+			fprintf(stderr, "[init_writer]%s\n", my_strerror());
+			return 1;
+		}
+		if (init_uart(uart_baud, baud_rate, writer_write) == (-1)) {
+			fprintf(stderr, "[init_uart]%s\n", my_strerror());
+			return 1;
+		}
+		output_bit = uart_output_bit;
+		set_bit_rate = uart_set_bit_rate;
+	} else if (format == FMT_WAV || format == FMT_PCM) {
+		fprintf(log_fp, "*** START *** baseband audio file generation mode\n");
+		if (init_writer(ofile_name, buf_size, n_bufs, direct) == (-1)) {
+			fprintf(stderr, "[init_writer]%s\n", my_strerror());
+			return 1;
+		}
+		if (init_wav(ofile_name, sample_rate, baud_rate, amplitude, lpf, format == FMT_WAV) == (-1)) {
+			fprintf(stderr, "[init_wav]%s\n", my_strerror());
+			return 1;
+		}
+		output_bit = wav_output_bit;
+		set_bit_rate = wav_set_bit_rate;
+		start_offset = wav_start_offset;
+		if (start_ns) {
+			if (wav_start_offset(lead) == (-1)) {
+				fprintf(stderr, "[wav_start_offset]%s\n", my_strerror());
+				return 1;
+			}
+			fprintf(log_fp, "Leading silence: %lf samples\n", lead);
+		}
+		if (verbose) {
+			WAV_params *wav_p = get_wav_params();
+			fprintf(log_fp, "Sample rate: %ld\n", sample_rate);
+			fprintf(log_fp, "Samples per bit: %lf\n", (double)sample_rate / (double)baud_rate);
+			if (wav_p->n_taps) fprintf(log_fp, "Low-pass filter: %ld Hz, %ld taps\n", wav_p->lpf, wav_p->n_taps);
+		}
+	} else if (!isSerial) {
+		fprintf(log_fp, "*** START *** SDR I/Q file generation mode\n");
+		if (init_writer(ofile_name, buf_size, n_bufs, direct) == (-1)) {
+			fprintf(stderr, "[init_writer]%s\n", my_strerror());
 			return 1;
 		}
 
-		if (init_fsk(sample_rate, dev, baud_rate, amplitude, ofp) == (-1)) {
+		if (init_fsk(sample_rate, dev, baud_rate, amplitude) == (-1)) {
 			fprintf(stderr, "[init_fsk]%s\n", my_strerror());
 			return 1;
 		}
+		if (start_ns) {
+			if (fsk_start_offset(lead) == (-1)) {
+				fprintf(stderr, "[fsk_start_offset]%s\n", my_strerror());
+				return 1;
+			}
+			// the first bit edge is rounded up to the next sample
+			fprintf(log_fp, "Leading silence: %lf samples, first bit edge at sample %lld, alignment error %+.1lf nsecs\n",
+				lead, get_fsk_params()->lead_samples, ((double)get_fsk_params()->lead_samples - lead) * 1e9 / (double)sample_rate);
+		}
 
 		if (verbose) {
 			FSK_params *fsk_p = get_fsk_params();
-			printf("Sample rate: %ld\n", sample_rate);
-			printf("Samples per bit: %ld/%lf\n", fsk_p->cycles_per_bit, fsk_p->cycles_per_bit_d);
-			printf("Samples per freq cycle: %ld/%lf\n", fsk_p->divider, fsk_p->divider_d);
+			fprintf(log_fp, "Sample rate: %ld\n", sample_rate);
+			fprintf(log_fp, "Samples per bit: %ld/%lf\n", fsk_p->cycles_per_bit, fsk_p->cycles_per_bit_d);
+			fprintf(log_fp, "Samples per freq cycle: %ld/%lf\n", fsk_p->divider, fsk_p->divider_d);
 		}
 	} else {
 		if (KeepPTT) {
-			printf("*** START *** COM port PTT keeper mode\n");
+			fprintf(log_fp, "*** START *** COM port PTT keeper mode\n");
+		} else if (uart_baud) {
+			fprintf(log_fp, "*** START *** COM port UART TX encoder mode\n");
 		} else {
-			printf("*** START *** COM port encoder mode\n");
+			fprintf(log_fp, "*** START *** COM port encoder mode\n");
 		}
-		if (init_serial(ofile, baud_rate, PTTdelay, DtrRtsX, PTTinv, KeepPTT) == (-1)) {
+		if (init_serial(ofile, baud_rate, PTTdelay, DtrRtsX, PTTinv, KeepPTT, uart_baud) == (-1)) {
 			fprintf(stderr, "[init_serial]%s\n", my_strerror());
 			return 1;
 		}
-		if (start_serial() == (-1)) {
+		output_bit = serial_output_bit;
+		set_bit_rate = serial_set_bit_rate;
+		if (start_ns) {
+			COM_params *com_p = get_serial_params();
+			LARGE_INTEGER now;
+			start_ts = serial_epoch_ticks(start_ns);
+			QueryPerformanceCounter(&now);
+			if (start_ts - (int64_t)PTTdelay * com_p->ticks_per_second.QuadPart / 1000 < now.QuadPart) {
+				fprintf(log_fp, "*** WARNING *** start time is too close or has already passed\n");
+			} else {
+				fprintf(log_fp, "Waiting %lf seconds for the start time\n", (double)(start_ts - now.QuadPart) / (double)com_p->ticks_per_second.QuadPart);
+			}
+		}
+		// queued transmissions are keyed one by one while sending
+		if (q == NULL && start_serial(start_ts) == (-1)) {
 			fprintf(stderr, "[start_serial]%s\n", my_strerror());
 			return 1;
 		}
 		if (verbose) {
 			COM_params *com_p = get_serial_params();
-			printf("Ticks per second: %lld\n", com_p->ticks_per_second.QuadPart);
-			printf("Ticks per bit: %lld\n", com_p->ticks_per_bit);
+			fprintf(log_fp, "Ticks per second: %lld\n", com_p->ticks_per_second.QuadPart);
+			fprintf(log_fp, "Ticks per bit: %lld\n", com_p->ticks_per_bit);
 		}
 	}
-	p_tx = create_preamble();
-	if (p_tx == NULL) {
-		fprintf(stderr, "[create_preamble]%s\n", my_strerror());
-		return 1;
+	if (isSweep) {
+		if (idx_file == NULL) {
+			snprintf(idx_name, _MAX_PATH, "%s.idx", (isSerial || !strcmp(ofile_name, "-")) ? sweep_name : ofile_name);
+			idx_file = idx_name;
+		}
+		idx_fp = fopen(idx_file, "w");
+		if (idx_fp == NULL) {
+			fprintf(stderr, "Can't open sweep index file '%s': %s\n", idx_file, strerror(errno));
+			return 1;
+		}
 	}
-
-	if (p_tbl != NULL) {
-		uint8_t *recoded_msg = malloc(strlen(msg) + 1);
-		int i;
-		if (recoded_msg == NULL) {
-			fprintf(stderr, "Can't allocate memory for recoded message\n");
+	if (format == FMT_CW) {
+		if (write_cw_header(ofp) == (-1)) {
+			fprintf(stderr, "[write_cw_header]%s\n", my_strerror());
 			return 1;
 		}
-		for (i = 0; msg[i]; i++) {
-			recoded_msg[i] = p_tbl->table[msg[i]];
+		if (isSweep) {
+			if (sweep_out(sw, p_tx, NULL, ofp, idx_fp, verbose, log_fp) == (-1)) {
+				fprintf(stderr, "[sweep_out]%s\n", my_strerror());
+				return 1;
+			}
 		}
-		recoded_msg[i] = 0;
-		if (verbose) {
-			printf("Original message: '%s'\n Recoded message: '%s'\n", msg, recoded_msg);
+		for (seg = isSweep ? NULL : p_tx; seg != NULL; seg = seg->next) {
+			if (write_cw_segment(ofp, seg) == (-1)) {
+				fprintf(stderr, "[write_cw_segment]%s\n", my_strerror());
+				return 1;
+			}
+		}
+	} else if (isSweep) {
+		if (sweep_out(sw, p_tx, output_bit, NULL, idx_fp, verbose, log_fp) == (-1)) {
+			fprintf(stderr, "[sweep_out]%s\n", my_strerror());
+		}
+	} else {
+		LARGE_INTEGER sched_start, now;
+		QueryPerformanceCounter(&sched_start);
+		for (seg = p_tx; seg != NULL; seg = seg->next) {
+			if (isSerial && q != NULL) {
+				// PTT is kept on for the whole transmission, idle time between transmissions is waited out unkeyed
+				COM_params *com_p = get_serial_params();
+				int64_t elapsed_ms, first_edge_ts = 0;
+				uint32_t ptt_misses = com_p->ptt_misses;
+				if (start_ts) {
+					// schedule time 0 is the start time; start_ms is when PTT is keyed, the first bit edge follows PTT delay later
+					first_edge_ts = start_ts + (int64_t)(seg->start_ms + q->tx_overhead_ms) * com_p->ticks_per_second.QuadPart / 1000;
+				} else {
+					QueryPerformanceCounter(&now);
+					elapsed_ms = (now.QuadPart - sched_start.QuadPart) * 1000 / com_p->ticks_per_second.QuadPart;
+					if ((int64_t)seg->start_ms > elapsed_ms) Sleep((DWORD)(seg->start_ms - elapsed_ms));
+				}
+				if (start_serial(first_edge_ts) == (-1)) {
+					fprintf(stderr, "[start_serial]%s\n", my_strerror());
+					break;
+				}
+				if (com_p->ptt_misses != ptt_misses) {
+					fprintf(log_fp, "*** WARNING *** PTT of the transmission scheduled at %lf seconds is keyed late\n", (double)seg->start_ms / 1000.0);
+				}
+			}
+			if (seg->baud_rate != baud_rate) {
+				// rate switch at the segment boundary, the output keeps running without gaps
+				baud_rate = seg->baud_rate;
+				if (set_bit_rate(baud_rate) == (-1)) {
+					fprintf(stderr, "[set_bit_rate]%s\n", my_strerror());
+					break;
+				}
+			}
+			// the bit edge is placed at the rate of the segment it starts
+			if (timed && start_offset(lead + (double)seg->start_ms * sample_rate / 1000.0) == (-1)) {
+				fprintf(stderr, "[start_offset]%s\n", my_strerror());
+				break;
+			}
+			if (verbose && p_tx->next != NULL) {
+				fprintf(log_fp, "Segment: %ld bps, %ld preamble codewords, %ld batches\n", seg->baud_rate, seg->preamble_len, seg->n_batches);
+			}
+			if (pocsag_out(seg, output_bit, seg->inv, verbose, log_fp) == (-1)) {
+				fprintf(stderr, "[pocsag_out]%s\n", my_strerror());
+				break;
+			}
+			if (isSerial && q != NULL && end_serial() == (-1)) {
+				fprintf(stderr, "[end_serial]%s\n", my_strerror());
+				break;
+			}
 		}
-		msg = recoded_msg;
-	}
-	if (add_message(p_tx, cap_code, func, msg, isNum) == (-1)) {
-		fprintf(stderr, "[add_message]%s\n", my_strerror());
-		return 1;
-	}
-
-	if (pocsag_out(p_tx, isSerial ? serial_output_bit : fsk_output_bit, inv, verbose) == (-1)) {
-		fprintf(stderr, "[pocsag_out]%s\n", my_strerror());
 	}
 
-	if (isSerial) {
+	if (format == FMT_CW) {
+		uint32_t n_batches = 0;
+		if (ofp != stdout && fclose(ofp) == EOF) {
+			fprintf(stderr, "Can't write output file '%s': %s\n", ofile_name, strerror(errno));
+			return 1;
+		}
+		for (seg = p_tx; seg != NULL; seg = seg->next) n_batches += seg->n_batches;
+		fprintf(log_fp, "*** FINISH *** %ld batches have been written to '%s'\n", n_batches, ofile_name);
+	} else if (isSerial) {
 		COM_params *com_p = get_serial_params();
-		if (end_serial() == (-1)) {
+		double keyed_secs;
+		if (q == NULL && end_serial() == (-1)) {
 			fprintf(stderr, "[end_serial]%s\n", my_strerror());
 		}
-		printf("*** FINISH *** %ld bits have been sent, frequency: %lld, calculated # of ticks per bit: %lld, average # of ticks per bit: %lld\n", com_p->total_bits_sent,com_p->ticks_per_second.QuadPart,com_p->ticks_per_bit,(com_p->last_bit_ts.QuadPart - com_p->first_bit_ts.QuadPart)/com_p->total_bits_sent);
+		// queued transmissions are keyed one by one, the totals are over all keyings
+		fprintf(log_fp, "*** FINISH *** %lld bits have been sent, frequency: %lld, calculated # of ticks per bit: %lld, average # of ticks per bit: %lld\n", com_p->all_bits_sent,com_p->ticks_per_second.QuadPart,com_p->ticks_per_bit,com_p->all_bits_sent ? com_p->bit_ticks/com_p->all_bits_sent : 0);
 		if (com_p->bits_with_delays) {
-			printf("*** WARNING *** %ld bits have been sent with delays, maximum delay is %lld ticks (%lf seconds)\n", com_p->bits_with_delays, com_p->max_delay,(double)com_p->max_delay/(double)com_p->ticks_per_second.QuadPart);
+			fprintf(log_fp, "*** WARNING *** %ld bits have been sent with delays, maximum delay is %lld ticks (%lf seconds)\n", com_p->bits_with_delays, com_p->max_delay,(double)com_p->max_delay/(double)com_p->ticks_per_second.QuadPart);
 		}
+		keyed_secs = (double)com_p->keyed_ticks / (double)com_p->ticks_per_second.QuadPart;
+		if (keyed_secs > 0) {
+			fprintf(log_fp, "%lld bits in %ld keyings, PTT on for %lf seconds: effective rate %lf bps of %ld bps channel rate (%.1lf%%)\n",
+				com_p->all_bits_sent, com_p->keyings, keyed_secs, (double)com_p->all_bits_sent / keyed_secs, baud_rate,
+				100.0 * (double)com_p->all_bits_sent / keyed_secs / (double)baud_rate);
+			STATS_COUNTER("keyings", com_p->keyings);
+			STATS_COUNTER("keyed_seconds", keyed_secs);
+			STATS_COUNTER("effective_bps", (double)com_p->all_bits_sent / keyed_secs);
+		}
+		STATS_COUNTER("bits_sent", com_p->all_bits_sent);
+		STATS_COUNTER("bits_with_delays", com_p->bits_with_delays);
+		STATS_COUNTER("max_delay_seconds", (double)com_p->max_delay / (double)com_p->ticks_per_second.QuadPart);
 		// printf("GetTickCount stats: %ld msecs has elapsed, %lf msecs per bit\n", com_p->dwEnd - com_p->dwStart, (double)(com_p->dwEnd - com_p->dwStart) / (double)com_p->total_bits_sent);
+		if (com_p->aligned_keyings) {
+			double us_per_tick = 1e6 / (double)com_p->ticks_per_second.QuadPart;
+			fprintf(log_fp, "First bit edge alignment error: mean %+.1lf usecs, maximum %+.1lf usecs over %ld keyings\n",
+				(double)com_p->align_err_sum / com_p->aligned_keyings * us_per_tick, (double)com_p->align_err_max * us_per_tick, com_p->aligned_keyings);
+			STATS_COUNTER("align_error_max_usecs", (double)com_p->align_err_max * us_per_tick);
+			if (com_p->timed_waits) {
+				fprintf(log_fp, "Wait for the first bit edge overshot: mean %.1lf usecs, maximum %.1lf usecs\n",
+					(double)com_p->wait_late_sum / com_p->timed_waits * us_per_tick, (double)com_p->wait_late_max * us_per_tick);
+				STATS_COUNTER("wait_overshoot_max_usecs", (double)com_p->wait_late_max * us_per_tick);
+			}
+		}
+		if (com_p->ptt_misses) {
+			fprintf(log_fp, "*** WARNING *** PTT has been keyed late, after its scheduled time, %ld times\n", com_p->ptt_misses);
+		}
+		if (com_p->edge_misses) {
+			fprintf(log_fp, "*** WARNING *** the first bit edge has been sent late, after its scheduled time, %ld times\n", com_p->edge_misses);
+		}
+		STATS_COUNTER("ptt_misses", com_p->ptt_misses);
+		STATS_COUNTER("edge_misses", com_p->edge_misses);
+		if (uart_baud) {
+			print_uart_stats(log_fp);
+			if (com_p->tx_underruns) {
+				fprintf(log_fp, "*** WARNING *** UART has run out of data %ld times, the signal has gaps\n", com_p->tx_underruns);
+			}
+			STATS_COUNTER("uart_underruns", com_p->tx_underruns);
+		}
+	} else if (uart_baud) {
+		if (end_uart() == (-1) || end_writer() == (-1)) {
+			fprintf(stderr, "[end_uart]%s\n", my_strerror());
+			return 1;
+		}
+		fprintf(log_fp, "*** FINISH *** UART data have been successfully written to '%s'\n", ofile_name);
+		print_uart_stats(log_fp);
+	} else if (format == FMT_WAV || format == FMT_PCM) {
+		WAV_params *wav_p;
+		double audio_secs, render_secs;
+		if (end_wav() == (-1)) {
+			fprintf(stderr, "[end_wav]%s\n", my_strerror());
+			return 1;
+		}
+		wav_p = get_wav_params();
+		audio_secs = (double)wav_p->samples / (double)wav_p->sample_rate;
+		render_secs = (double)wav_p->render_ticks / (double)wav_p->ticks_per_second.QuadPart;
+		fprintf(log_fp, "*** FINISH *** %lf seconds of audio (%lld samples) have been successfully written to '%s'\n", audio_secs, wav_p->samples, ofile_name);
+		if (render_secs > 0) {
+			fprintf(log_fp, "Rendered in %lf seconds, %.0lf times faster than real time\n", render_secs, audio_secs / render_secs);
+		}
+		STATS_COUNTER("audio_seconds", audio_secs);
 	} else {
-		fclose(ofp);
-		printf("*** FINISH *** I/Q data have been successfully written to '%s'\n",ofile_name);
+		FSK_params *fsk_p = get_fsk_params();
+		if (loop) {
+			for (seg = p_tx; seg->next != NULL; seg = seg->next);
+			if (fsk_loop_pad(CW_IDLE, CW_PREAMBLE, seg->inv, (uint64_t)gap_ms * sample_rate / 1000, loop_tol) == (-1)) {
+				fprintf(stderr, "[fsk_loop_pad]%s\n", my_strerror());
+				return 1;
+			}
+		}
+		if (end_fsk() == (-1)) {
+			fprintf(stderr, "[end_fsk]%s\n", my_strerror());
+			return 1;
+		}
+		if (loop) {
+			fprintf(log_fp, "Loop: %lld samples (%lf seconds, %lld bytes), %ld idle codewords, %ld preamble bits and %lld gap samples added, phase error %+.2lf degrees\n",
+				fsk_p->samples, (double)fsk_p->samples / (double)sample_rate, fsk_p->samples * 2, fsk_p->pad_cws, fsk_p->pad_bits, fsk_p->gap_samples,
+				360.0 * (double)fsk_p->phase_err / (double)fsk_p->divider);
+			STATS_COUNTER("loop_samples", fsk_p->samples);
+		}
+		fprintf(log_fp, "*** FINISH *** I/Q data have been successfully written to '%s'\n",ofile_name);
+		if (verbose) {
+			WRITER_params *wr_p = get_writer_params();
+			fprintf(log_fp, "Renderer blocked on I/O: %lf seconds in %ld waits, writer thread busy: %lf seconds\n",
+				(double)wr_p->blocked_ticks / (double)wr_p->ticks_per_second.QuadPart, wr_p->blocked_waits,
+				(double)wr_p->write_ticks / (double)wr_p->ticks_per_second.QuadPart);
+		}
+	}
+	if (isSweep) {
+		if (fclose(idx_fp) == EOF) {
+			fprintf(stderr, "Can't write sweep index file '%s': %s\n", idx_file, strerror(errno));
+			return 1;
+		}
+		fprintf(log_fp, "Sweep index of %lld capcodes in %lld batches has been written to '%s'\n", sw->capcodes_sent, sw->batches_sent, idx_file);
+		STATS_COUNTER("sweep_capcodes", sw->capcodes_sent);
+	}
+	if (verbose || show_stats) {
+		STATS_DUMP(log_fp);
 	}
     return 0;
 }
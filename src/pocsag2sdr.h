@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdio.h>
 #include "my_strerror.h"
 
 #define	CW_PREAMBLE	0xAAAAAAAA
@@ -11,20 +12,49 @@ typedef struct POCSAG_batch {
 	struct POCSAG_batch *next;
 } POCSAG_batch;
 
+#define	PREAMBLE_LEN	18	// default preamble length in codewords
+
+// codeword stream file: file header followed by segments, all numbers are little-endian
+#define	CW_FILE_MAGIC	"P2CW"
+#define	CW_FILE_VERSION	1
+#define	CW_FILE_HDR_LEN	8	// magic[4], version u16, reserved u16
+#define	CW_SEG_HDR_LEN	16	// baud u32, flags u16, preamble length u16, batch count u32, reserved u32
+#define	CW_SEG_INV		1	// segment flag: inverted polarity
+#define	CW_MAX_PREAMBLE	0xFFFF	// preamble length is stored in 16 bits
+
+// one transmission segment: preamble followed by batches, sent with its own baud rate
 typedef struct POCSAG_tx {
-	uint32_t preamble[18];
-	int cur_idx,isEOL;
+	uint32_t preamble_len;
+	uint32_t n_batches;
+	uint32_t baud_rate;
+	int inv;
+	uint64_t start_ms;		// scheduled start of a queued transmission
+	uint32_t cur_idx;
+	int isEOL;
 	POCSAG_batch *cur_btch;
 	POCSAG_batch *first;
 	POCSAG_batch *last;
+	struct POCSAG_tx *next;	// next segment of the same transmission
 } POCSAG_tx;
 
 POCSAG_batch *create_batch(void);
 POCSAG_tx *create_preamble(void);
+void free_tx(POCSAG_tx *p_tx);
 uint32_t make_csum(uint32_t dw);
+uint32_t address_cw(uint32_t capcode, uint32_t func);
 int add_message(POCSAG_tx *p_tx, uint32_t capcode, uint32_t func, uint8_t *msg, int isNum);
 uint32_t get_cws(POCSAG_tx *p_tx, uint32_t *buf, uint32_t len);
+uint32_t message_cws(uint8_t *msg, int isNum);
+uint32_t message_batches(uint32_t capcode, uint8_t *msg, int isNum);
+uint64_t tx_bits(POCSAG_tx *p_tx);
+
+int write_cw_header(FILE *fp);
+int write_cw_segment_header(FILE *fp, POCSAG_tx *p_tx);
+int write_cw_batch(FILE *fp, POCSAG_batch *btch);
+int write_cw_segment(FILE *fp, POCSAG_tx *p_tx);
+int read_cw_header(FILE *fp);
+int read_cw_segment(FILE *fp, POCSAG_tx **pp_tx);
 
 uint32_t pocsag_bch(uint32_t dw);
 
-int pocsag_out(POCSAG_tx *p_tx, int (*output_bit)(int bit), int inv, int verbose);
+int pocsag_out(POCSAG_tx *p_tx, int (*output_bit)(int bit), int inv, int verbose, FILE *log_fp);
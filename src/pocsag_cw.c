@@ -0,0 +1,146 @@
+/*
+File:	pocsag_cw.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Compact codeword stream files: encoded POCSAG transmissions without any modulation applied,
+to be rendered later with any sample rate, deviation or output format.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pocsag2sdr.h"
+
+static void put_u16(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u16(uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get_u32(uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int write_cw_header(FILE *fp) {
+	uint8_t hdr[CW_FILE_HDR_LEN];
+	memcpy(hdr, CW_FILE_MAGIC, 4);
+	put_u16(hdr + 4, CW_FILE_VERSION);
+	put_u16(hdr + 6, 0);
+	if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+		set_error(ERR_ERRNO, "[fwrite]");
+		return (-1);
+	}
+	return 0;
+}
+
+// segment header only, n_batches batches have to follow
+int write_cw_segment_header(FILE *fp, POCSAG_tx *p_tx) {
+	uint8_t hdr[CW_SEG_HDR_LEN];
+
+	if (p_tx->preamble_len > CW_MAX_PREAMBLE) {
+		set_error(ERR_MSG, "Preamble of %lu codewords is too long for a codeword stream, %lu at most", (unsigned long)p_tx->preamble_len, (unsigned long)CW_MAX_PREAMBLE);
+		return (-1);
+	}
+	put_u32(hdr, p_tx->baud_rate);
+	put_u16(hdr + 4, p_tx->inv ? CW_SEG_INV : 0);
+	put_u16(hdr + 6, p_tx->preamble_len);
+	put_u32(hdr + 8, p_tx->n_batches);
+	put_u32(hdr + 12, 0);
+	if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+		set_error(ERR_ERRNO, "[fwrite]");
+		return (-1);
+	}
+	return 0;
+}
+
+int write_cw_batch(FILE *fp, POCSAG_batch *btch) {
+	uint8_t data[4 * 16];
+	int i;
+	// sync codeword is implied and not stored
+	for (i = 0; i < 16; i++) {
+		put_u32(data + 4 * i, btch->data[i + 1]);
+	}
+	if (fwrite(data, 1, sizeof(data), fp) != sizeof(data)) {
+		set_error(ERR_ERRNO, "[fwrite]");
+		return (-1);
+	}
+	return 0;
+}
+
+int write_cw_segment(FILE *fp, POCSAG_tx *p_tx) {
+	POCSAG_batch *btch;
+	if (write_cw_segment_header(fp, p_tx) == (-1)) return (-1);
+	for (btch = p_tx->first; btch != NULL; btch = btch->next) {
+		if (write_cw_batch(fp, btch) == (-1)) return (-1);
+	}
+	return 0;
+}
+
+int read_cw_header(FILE *fp) {
+	uint8_t hdr[CW_FILE_HDR_LEN];
+	if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || memcmp(hdr, CW_FILE_MAGIC, 4)) {
+		set_error(ERR_MSG, "Not a codeword stream file");
+		return (-1);
+	}
+	if (get_u16(hdr + 4) != CW_FILE_VERSION) {
+		set_error(ERR_MSG, "Unsupported codeword stream version %lu", (unsigned long)get_u16(hdr + 4));
+		return (-1);
+	}
+	return 0;
+}
+
+int read_cw_segment(FILE *fp, POCSAG_tx **pp_tx) {
+	uint8_t hdr[CW_SEG_HDR_LEN];
+	uint8_t data[4 * 16];
+	POCSAG_tx *p_tx;
+	uint32_t n, n_batches, baud;
+	size_t l;
+	int i;
+
+	l = fread(hdr, 1, sizeof(hdr), fp);
+	if (l == 0 && feof(fp)) return 0;
+	if (l != sizeof(hdr)) {
+		set_error(ERR_MSG, "Truncated codeword stream segment header");
+		return (-1);
+	}
+	baud = get_u32(hdr);
+	n_batches = get_u32(hdr + 8);
+	if (baud == 0 || n_batches == 0) {
+		set_error(ERR_MSG, "Invalid codeword stream segment: %lu bps, %lu batches", (unsigned long)baud, (unsigned long)n_batches);
+		return (-1);
+	}
+
+	p_tx = create_preamble();
+	if (p_tx == NULL) return (-1);
+	p_tx->baud_rate = baud;
+	p_tx->inv = (get_u16(hdr + 4) & CW_SEG_INV) != 0;
+	p_tx->preamble_len = get_u16(hdr + 6);
+	for (n = 0; n < n_batches; n++) {
+		POCSAG_batch *btch = p_tx->last;
+		if (n != 0) {
+			btch = create_batch();
+			if (btch == NULL) return (-1);
+			p_tx->last->next = btch;
+			p_tx->last = btch;
+			p_tx->n_batches++;
+		}
+		if (fread(data, 1, sizeof(data), fp) != sizeof(data)) {
+			set_error(ERR_MSG, "Truncated codeword stream: %lu of %lu batches read", (unsigned long)n, (unsigned long)n_batches);
+			return (-1);
+		}
+		for (i = 0; i < 16; i++) {
+			btch->data[i + 1] = get_u32(data + 4 * i);
+		}
+	}
+	*pp_tx = p_tx;
+	return 1;
+}
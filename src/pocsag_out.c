@@ -10,25 +10,29 @@ For any other purposes please contact me at e-mail above or any other e-mail lis
 #include <stdio.h>
 
 #include "pocsag2sdr.h"
+#include "stats.h"
 
 static uint32_t cycles;
 
-int pocsag_out( POCSAG_tx *p_tx,int (*output_bit)(int bit),int inv,int verbose ) {
-	uint32_t p_cw;
-	int i;
+// the codeword dump goes to log_fp, which isn't stdout when the output data are
+int pocsag_out( POCSAG_tx *p_tx,int (*output_bit)(int bit),int inv,int verbose,FILE *log_fp ) {
+	uint32_t p_cw, i;
+	STATS_START(t0);
 	for (i = 0; get_cws(p_tx, &p_cw, 4) == 4; i++) {
 		int j;
 		uint32_t mask;
-		if (i == 18 || (i > 18 && (i - 18) % 17 == 0)) {
-			if (verbose>1) printf("\n");
+		if (i == p_tx->preamble_len || (i > p_tx->preamble_len && (i - p_tx->preamble_len) % 17 == 0)) {
+			if (verbose>1) fprintf(log_fp, "\n");
 		}
-		if (verbose>1) printf("%08lX ", p_cw);
+		if (verbose>1) fprintf(log_fp, "%08lX ", p_cw);
 		for (j = 0, mask = 0x80000000; j < 32; j++, mask >>= 1) {
 			if (output_bit(((p_cw & mask) != 0) ^ inv) == (-1)) {
+				STATS_STOP(STAGE_OUTPUT, t0, (uint64_t)i * 4, 0);
 				return (-1);
 			}
 		}
 	}
-	if (verbose>1) printf("\n");
+	if (verbose>1) fprintf(log_fp, "\n");
+	STATS_STOP(STAGE_OUTPUT, t0, (uint64_t)i * 4, 0);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,464 @@
+/*
+File:	pocsag_sched.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Transmit scheduler: queued pages are sent in order of priority and deadline rather than in order of arrival.
+Both queues are binary heaps, so adding and selecting a page is O(log n).
+Duplicates of a page arriving within a time window are suppressed with the help of a fixed size index of recent pages.
+A duty cycle governor delays transmissions to keep the keyed time in any rolling window under a limit.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pocsag2sdr.h"
+#include "pocsag_sched.h"
+
+static int arrives_before(SCHED_page *a, SCHED_page *b) {
+	if (a->arrival_ms != b->arrival_ms) return a->arrival_ms < b->arrival_ms;
+	return a->seq < b->seq;
+}
+
+static int sends_before(SCHED_page *a, SCHED_page *b) {
+	if (a->priority != b->priority) return a->priority > b->priority;
+	if (a->deadline_ms != b->deadline_ms) {
+		if (a->deadline_ms == SCHED_NO_DEADLINE) return 0;
+		if (b->deadline_ms == SCHED_NO_DEADLINE) return 1;
+		return a->deadline_ms < b->deadline_ms;
+	}
+	return a->seq < b->seq;
+}
+
+static void heap_set(SCHED_heap *h, uint32_t i, SCHED_page *pg) {
+	h->pages[i] = pg;
+	pg->heap_idx = i;
+}
+
+static void heap_sift_up(SCHED_heap *h, uint32_t i) {
+	SCHED_page *pg = h->pages[i];
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+		if (!h->before(pg, h->pages[parent])) break;
+		heap_set(h, i, h->pages[parent]);
+		i = parent;
+	}
+	heap_set(h, i, pg);
+}
+
+static void heap_sift_down(SCHED_heap *h, uint32_t i) {
+	SCHED_page *pg = h->pages[i];
+	for (;;) {
+		uint32_t child = 2 * i + 1;
+		if (child >= h->n) break;
+		if (child + 1 < h->n && h->before(h->pages[child + 1], h->pages[child])) child++;
+		if (!h->before(h->pages[child], pg)) break;
+		heap_set(h, i, h->pages[child]);
+		i = child;
+	}
+	heap_set(h, i, pg);
+}
+
+static int heap_push(SCHED_heap *h, SCHED_page *pg) {
+	if (h->n == h->size) {
+		uint32_t new_size = h->size ? h->size * 2 : 64;
+		SCHED_page **pages = realloc(h->pages, new_size * sizeof(SCHED_page *));
+		if (pages == NULL) {
+			set_error(ERR_ERRNO, "[realloc]");
+			return (-1);
+		}
+		h->pages = pages;
+		h->size = new_size;
+	}
+	h->pages[h->n] = pg;
+	heap_sift_up(h, h->n++);
+	return 0;
+}
+
+static SCHED_page *heap_pop(SCHED_heap *h) {
+	SCHED_page *top = h->pages[0];
+	if (--h->n > 0) {
+		h->pages[0] = h->pages[h->n];
+		heap_sift_down(h, 0);
+	}
+	return top;
+}
+
+SCHED_queue *create_sched(void) {
+	SCHED_queue *q = calloc(1, sizeof(SCHED_queue));
+	if (q == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return NULL;
+	}
+	q->pending.before = arrives_before;
+	q->ready.before = sends_before;
+	return q;
+}
+
+static void free_heap(SCHED_heap *h) {
+	uint32_t i;
+	for (i = 0; i < h->n; i++) {
+		free(h->pages[i]->msg);
+		free(h->pages[i]);
+	}
+	free(h->pages);
+}
+
+// frees the queue with all the pages not sent yet
+void free_sched(SCHED_queue *q) {
+	if (q == NULL) return;
+	free_heap(&q->pending);
+	free_heap(&q->ready);
+	free(q->recent);
+	free(q->keyed);
+	free(q);
+}
+
+// frees a list of pages taken into a transmission
+static void free_pages(SCHED_page *pg) {
+	while (pg != NULL) {
+		SCHED_page *next = pg->next;
+		free(pg->msg);
+		free(pg);
+		pg = next;
+	}
+}
+
+int sched_set_dedup(SCHED_queue *q, uint32_t window_ms, uint32_t size) {
+	q->dup_window_ms = window_ms;
+	if (window_ms == 0) return 0;
+	if (size == 0) {
+		set_error(ERR_MSG, "Recent page index can't be empty");
+		return (-1);
+	}
+	q->recent = calloc(size, sizeof(SCHED_recent));
+	if (q->recent == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	q->recent_size = size;
+	return 0;
+}
+
+int sched_set_duty(SCHED_queue *q, double pct, uint32_t window_ms) {
+	if (pct < 0 || pct > 100 || (pct != 0 && window_ms == 0)) {
+		set_error(ERR_MSG, "Invalid duty cycle %lf%% over %lu msecs", pct, (unsigned long)window_ms);
+		return (-1);
+	}
+	q->duty_pct = pct == 100 ? 0 : pct;
+	q->duty_window_ms = window_ms;
+	return 0;
+}
+
+// keyed time between from_ms and to_ms
+static uint64_t keyed_between(SCHED_queue *q, int64_t from_ms, uint64_t to_ms) {
+	uint64_t used = 0;
+	uint32_t i;
+	for (i = 0; i < q->n_keyed; i++) {
+		int64_t a = (int64_t)q->keyed[i].start_ms > from_ms ? (int64_t)q->keyed[i].start_ms : from_ms;
+		uint64_t b = q->keyed[i].end_ms < to_ms ? q->keyed[i].end_ms : to_ms;
+		if ((int64_t)b > a) used += b - (uint64_t)a;
+	}
+	return used;
+}
+
+// utilisation of the window which ends at now_ms in percent
+double sched_duty(SCHED_queue *q, uint64_t now_ms) {
+	if (q->duty_window_ms == 0) return 0;
+	return 100.0 * (double)keyed_between(q, (int64_t)now_ms - q->duty_window_ms, now_ms) / (double)q->duty_window_ms;
+}
+
+/*
+Earliest start not before now_ms for a transmission keyed for key_ms. All earlier transmissions end by now_ms,
+so the window which ends with the new one is the worst: its start is moved forward over the keyed intervals
+until the excess over the budget is gone.
+*/
+static uint64_t duty_start(SCHED_queue *q, uint64_t now_ms, uint64_t key_ms) {
+	int64_t budget = (int64_t)(q->duty_pct / 100.0 * (double)q->duty_window_ms);
+	int64_t from = (int64_t)(now_ms + key_ms) - q->duty_window_ms;
+	int64_t excess = (int64_t)keyed_between(q, from, now_ms) + (int64_t)key_ms - budget;
+	uint32_t i;
+
+	if (excess <= 0) return now_ms;
+	for (i = 0; i < q->n_keyed && excess > 0; i++) {
+		int64_t a = (int64_t)q->keyed[i].start_ms > from ? (int64_t)q->keyed[i].start_ms : from;
+		int64_t b = (int64_t)q->keyed[i].end_ms;
+		if (b <= a) continue;
+		if (b - a >= excess) {
+			from = a + excess;
+			excess = 0;
+		} else {
+			excess -= b - a;
+			from = b;
+		}
+	}
+	// an overrun can't get under the budget, it waits until the window is clear of the others
+	return (uint64_t)(from + q->duty_window_ms) - key_ms;
+}
+
+static int add_keyed(SCHED_queue *q, uint64_t start_ms, uint64_t end_ms) {
+	uint32_t i, n = 0;
+	// intervals ending before the window of the new one can't count anymore
+	for (i = 0; i < q->n_keyed; i++) {
+		if ((int64_t)q->keyed[i].end_ms > (int64_t)end_ms - q->duty_window_ms) q->keyed[n++] = q->keyed[i];
+	}
+	q->n_keyed = n;
+	if (q->n_keyed == q->keyed_size) {
+		uint32_t new_size = q->keyed_size ? q->keyed_size * 2 : 64;
+		SCHED_keyed *keyed = realloc(q->keyed, new_size * sizeof(SCHED_keyed));
+		if (keyed == NULL) {
+			set_error(ERR_ERRNO, "[realloc]");
+			return (-1);
+		}
+		q->keyed = keyed;
+		q->keyed_size = new_size;
+	}
+	q->keyed[q->n_keyed].start_ms = start_ms;
+	q->keyed[q->n_keyed].end_ms = end_ms;
+	q->n_keyed++;
+	return 0;
+}
+
+#define	FNV_OFFSET	0xCBF29CE484222325ULL
+#define	FNV_PRIME	0x100000001B3ULL
+
+static uint64_t fnv1a(uint64_t h, uint8_t *p, size_t len) {
+	while (len--) {
+		h ^= *p++;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static uint64_t page_hash(SCHED_page *pg) {
+	uint8_t key[6];
+	key[0] = (uint8_t)pg->capcode; key[1] = (uint8_t)(pg->capcode >> 8); key[2] = (uint8_t)(pg->capcode >> 16);
+	key[3] = (uint8_t)(pg->capcode >> 24); key[4] = (uint8_t)pg->func; key[5] = (uint8_t)pg->isNum;
+	return fnv1a(fnv1a(FNV_OFFSET, key, sizeof(key)), pg->msg, strlen(pg->msg));
+}
+
+static int same_page(SCHED_page *a, SCHED_page *b) {
+	return a->capcode == b->capcode && a->func == b->func && a->isNum == b->isNum && !strcmp(a->msg, b->msg);
+}
+
+// replacement order: free or expired entries, then sent pages, then queued ones, the oldest first
+static int evict_rank(SCHED_queue *q, SCHED_recent *r, uint64_t now_ms) {
+	if (!r->used || (r->page == NULL && now_ms > r->first_ms + q->dup_window_ms)) return 0;
+	return r->page == NULL ? 1 : 2;
+}
+
+/*
+Looks the page up among SCHED_DUP_PROBES entries following its hash. Returns the entry of the first copy
+if it arrived within the window, otherwise the entry to put the page into.
+Sent pages are known by the hash only, a queued copy is compared in full.
+*/
+static SCHED_recent *find_recent(SCHED_queue *q, SCHED_page *pg, int *is_dup) {
+	SCHED_recent *victim = NULL;
+	int victim_rank = 3;
+	uint32_t i;
+	*is_dup = 0;
+	for (i = 0; i < SCHED_DUP_PROBES && i < q->recent_size; i++) {
+		SCHED_recent *r = &q->recent[(pg->hash + i) % q->recent_size];
+		int rank = evict_rank(q, r, pg->arrival_ms);
+		if (r->used && r->hash == pg->hash && pg->arrival_ms <= r->first_ms + q->dup_window_ms &&
+			(r->page == NULL || same_page(r->page, pg))) {
+			*is_dup = 1;
+			return r;
+		}
+		if (rank < victim_rank || (rank == victim_rank && rank != 0 && r->first_ms < victim->first_ms)) {
+			victim = r;
+			victim_rank = rank;
+		}
+	}
+	return victim;
+}
+
+static void forget_page(SCHED_queue *q, SCHED_page *pg) {
+	uint32_t i;
+	for (i = 0; i < SCHED_DUP_PROBES && i < q->recent_size; i++) {
+		SCHED_recent *r = &q->recent[(pg->hash + i) % q->recent_size];
+		if (r->page == pg) r->page = NULL;
+	}
+}
+
+// page has arrived: it goes to the ready queue unless it's a duplicate
+// the page is freed if it can't be queued, it's off the pending heap already
+static int ready_push(SCHED_queue *q, SCHED_page *pg) {
+	if (heap_push(&q->ready, pg) == (-1)) {
+		free(pg->msg);
+		free(pg);
+		return (-1);
+	}
+	return 0;
+}
+
+static int page_arrived(SCHED_queue *q, SCHED_page *pg) {
+	SCHED_recent *r;
+	int is_dup;
+	if (q->dup_window_ms == 0) return ready_push(q, pg);
+
+	pg->hash = page_hash(pg);
+	r = find_recent(q, pg, &is_dup);
+	if (is_dup) {
+		SCHED_page *first = r->page;
+		if (first != NULL) {
+			// the first copy is still queued, it takes the more urgent priority and deadline of the two
+			if (pg->priority > first->priority) first->priority = pg->priority;
+			if (pg->deadline_ms != SCHED_NO_DEADLINE && (first->deadline_ms == SCHED_NO_DEADLINE || pg->deadline_ms < first->deadline_ms)) {
+				first->deadline_ms = pg->deadline_ms;
+			}
+			heap_sift_up(&q->ready, first->heap_idx);
+			q->dups_merged++;
+		} else {
+			q->dups_dropped++;
+		}
+		q->dup_bits_saved += (uint64_t)(1 + message_cws(pg->msg, pg->isNum)) * 32;
+		free(pg->msg);
+		free(pg);
+		return 0;
+	}
+	if (ready_push(q, pg) == (-1)) return (-1);
+	// an evicted page which is still queued just won't be matched anymore
+	r->used = 1;
+	r->hash = pg->hash;
+	r->first_ms = pg->arrival_ms;
+	r->page = pg;
+	return 0;
+}
+
+int sched_add(SCHED_queue *q, uint32_t capcode, uint32_t func, uint8_t *msg, int isNum, int priority, uint64_t arrival_ms, uint32_t deadline_ms) {
+	SCHED_page *pg = malloc(sizeof(SCHED_page));
+	if (pg == NULL || (pg->msg = malloc(strlen(msg) + 1)) == NULL) {
+		free(pg);
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	strcpy(pg->msg, msg);
+	pg->capcode = capcode;
+	pg->func = func & 3;
+	pg->isNum = isNum;
+	pg->priority = priority;
+	pg->arrival_ms = arrival_ms;
+	pg->deadline_ms = deadline_ms ? arrival_ms + deadline_ms : SCHED_NO_DEADLINE;
+	pg->seq = q->seq++;
+	return heap_push(&q->pending, pg);
+}
+
+int sched_is_empty(SCHED_queue *q) {
+	return q->pending.n == 0 && q->ready.n == 0;
+}
+
+/*
+Builds the next transmission: pages which have arrived by *now_ms are taken in priority order
+until the transmission would grow beyond max_batches (0 means no limit); at least one page is always taken,
+a single page longer than that is counted in size_overruns.
+If nothing has arrived yet, the clock is advanced to the next arrival.
+With the duty cycle governor the start is delayed until the transmission fits into the budget of the window.
+Returns 1 with the transmission in *pp_tx, 0 if the queue is empty, which may happen if the rest of it
+has been suppressed as duplicates, (-1) on error. On return *now_ms is the time the transmission ends, the start time is kept in start_ms of the transmission.
+*/
+int sched_next_tx(SCHED_queue *q, uint64_t *now_ms, uint32_t baud, int inv, uint32_t max_batches, POCSAG_tx **pp_tx) {
+	POCSAG_tx *p_tx;
+	SCHED_page *taken = NULL, **tail = &taken, *sent;
+	uint64_t key_ms, first_ms;
+	uint32_t size_limit = max_batches;
+	int n_pages = 0;
+
+	// arrivals which turn out to be duplicates don't count, the queue may even run dry
+	for (;;) {
+		if (q->ready.n == 0 && q->pending.n != 0 && q->pending.pages[0]->arrival_ms > *now_ms) {
+			*now_ms = q->pending.pages[0]->arrival_ms;
+		}
+		while (q->pending.n != 0 && q->pending.pages[0]->arrival_ms <= *now_ms) {
+			if (page_arrived(q, heap_pop(&q->pending)) == (-1)) return (-1);
+		}
+		if (q->ready.n != 0 || q->pending.n == 0) break;
+	}
+	first_ms = *now_ms;
+	if (q->ready.n == 0) return 0;
+
+	if (q->duty_pct != 0) {
+		// wait as long as even the shortest transmission with the first page would have to,
+		// so pages arriving meanwhile go with it
+		SCHED_page *pg = q->ready.pages[0];
+		uint64_t min_bits = ((uint64_t)PREAMBLE_LEN + (uint64_t)message_batches(pg->capcode, pg->msg, pg->isNum) * 17) * 32;
+		uint64_t start_ms = duty_start(q, *now_ms, q->tx_overhead_ms + (min_bits * 1000 + baud - 1) / baud);
+		if (start_ms > *now_ms) {
+			*now_ms = start_ms;
+			while (q->pending.n != 0 && q->pending.pages[0]->arrival_ms <= *now_ms) {
+				if (page_arrived(q, heap_pop(&q->pending)) == (-1)) return (-1);
+			}
+		}
+	}
+
+	if (q->duty_pct != 0) {
+		// pages gathered while waiting mustn't make the transmission longer than the whole budget
+		int64_t budget_ms = (int64_t)(q->duty_pct / 100.0 * (double)q->duty_window_ms) - q->tx_overhead_ms;
+		int64_t duty_batches = (budget_ms * baud / 1000 / 32 - PREAMBLE_LEN) / 17;
+		if (duty_batches < 1) duty_batches = 1;
+		if (max_batches == 0 || duty_batches < max_batches) max_batches = (uint32_t)duty_batches;
+	}
+
+	p_tx = create_preamble();
+	if (p_tx == NULL) return (-1);
+	p_tx->baud_rate = baud;
+	p_tx->inv = inv;
+
+	while (q->ready.n != 0) {
+		SCHED_page *pg = q->ready.pages[0];
+		uint64_t end_bits;
+
+		if (n_pages != 0 && max_batches != 0 && p_tx->n_batches + message_batches(pg->capcode, pg->msg, pg->isNum) > max_batches) break;
+		heap_pop(&q->ready);
+		if (q->dup_window_ms != 0) forget_page(q, pg);
+		if (add_message(p_tx, pg->capcode, pg->func, pg->msg, pg->isNum) == (-1)) {
+			free_pages(pg);
+			free_pages(taken);
+			free_tx(p_tx);
+			return (-1);
+		}
+		// the page is on air when the batch with its last codeword is over
+		end_bits = ((uint64_t)p_tx->preamble_len + (uint64_t)(p_tx->n_batches - 1) * 17) * 32;
+		pg->end_ms = q->tx_overhead_ms + (end_bits * 1000 + baud - 1) / baud;
+		pg->next = NULL;
+		*tail = pg;
+		tail = &pg->next;
+		n_pages++;
+		q->pages_sent++;
+	}
+	if (size_limit != 0 && p_tx->n_batches > size_limit) q->size_overruns++;
+	// deadlines are checked once the start time is known
+	key_ms = q->tx_overhead_ms + (tx_bits(p_tx) * 1000 + baud - 1) / baud;
+	if (q->duty_pct != 0) {
+		uint64_t start_ms = duty_start(q, *now_ms, key_ms);
+		if ((double)key_ms > q->duty_pct / 100.0 * (double)q->duty_window_ms) q->duty_overruns++;
+		if (start_ms > first_ms) {
+			q->duty_delays++;
+			q->duty_delay_ms += start_ms - first_ms;
+		}
+		*now_ms = start_ms;
+	}
+	p_tx->start_ms = *now_ms;
+	for (sent = taken; sent != NULL; sent = sent->next) {
+		if (sent->deadline_ms != SCHED_NO_DEADLINE && *now_ms + sent->end_ms > sent->deadline_ms) {
+			q->deadline_misses++;
+		}
+	}
+	free_pages(taken);
+	*now_ms += key_ms;
+	q->keyed_ms += key_ms;
+	if (q->duty_window_ms != 0) {
+		double duty;
+		if (add_keyed(q, p_tx->start_ms, *now_ms) == (-1)) {
+			free_tx(p_tx);
+			return (-1);
+		}
+		duty = sched_duty(q, *now_ms);
+		if (duty > q->duty_peak) q->duty_peak = duty;
+	}
+	q->transmissions++;
+	*pp_tx = p_tx;
+	return 1;
+}
@@ -0,0 +1,78 @@
+#include <stdint.h>
+
+// POCSAG_tx comes from pocsag2sdr.h which must be included first
+
+#define	SCHED_NO_DEADLINE	0
+#define	SCHED_DUP_SIZE		1024	// default number of entries in the recent page index
+#define	SCHED_DUP_PROBES	8
+#define	SCHED_DUTY_WINDOW	3600000	// default duty cycle window, ms
+
+typedef struct SCHED_page {
+	uint32_t capcode, func;
+	int isNum;
+	int priority;			// higher value is sent first
+	uint64_t arrival_ms;	// the page can't be sent earlier
+	uint64_t deadline_ms;	// absolute time the page must be sent by, SCHED_NO_DEADLINE if none
+	uint32_t seq;			// arrival order among pages of the same priority and deadline
+	uint32_t heap_idx;
+	uint64_t end_ms;		// from the start of the transmission to the end of the page's last batch
+	struct SCHED_page *next;	// next page of the same transmission
+	uint64_t hash;			// of capcode, function and message
+	uint8_t *msg;
+} SCHED_page;
+
+// recent page index entry, a duplicate arriving within the window of first_ms is suppressed
+typedef struct SCHED_recent {
+	uint64_t hash;
+	uint64_t first_ms;
+	SCHED_page *page;		// still waiting in the ready queue, NULL if sent
+	int used;
+} SCHED_recent;
+
+// keyed interval of a transmission, [start_ms, end_ms)
+typedef struct SCHED_keyed {
+	uint64_t start_ms, end_ms;
+} SCHED_keyed;
+
+typedef struct SCHED_heap {
+	SCHED_page **pages;
+	uint32_t n, size;
+	int (*before)(SCHED_page *a, SCHED_page *b);
+} SCHED_heap;
+
+typedef struct SCHED_queue {
+	SCHED_heap pending;		// not arrived yet, ordered by arrival time
+	SCHED_heap ready;		// arrived, ordered by priority, then deadline
+	uint32_t seq;
+	uint32_t tx_overhead_ms;	// keying time before the preamble of every transmission, e.g. PTT delay
+	uint32_t pages_sent;
+	uint32_t deadline_misses;
+	uint32_t transmissions;
+	uint32_t size_overruns;		// single pages longer than max_batches, sent anyway
+	// duplicate suppression
+	uint32_t dup_window_ms;		// 0 if turned off
+	SCHED_recent *recent;
+	uint32_t recent_size;
+	uint32_t dups_dropped;		// the first copy has been sent already
+	uint32_t dups_merged;		// merged into the first copy still waiting to be sent
+	uint64_t dup_bits_saved;	// address and message codewords not sent
+	// duty cycle governor: keyed time in any window of duty_window_ms is kept under duty_pct percent
+	double duty_pct;			// 0 if turned off
+	uint32_t duty_window_ms;
+	SCHED_keyed *keyed;			// transmissions which still fall into the window, oldest first
+	uint32_t n_keyed, keyed_size;
+	uint64_t keyed_ms;			// total keyed time
+	uint32_t duty_delays;		// transmissions delayed
+	uint64_t duty_delay_ms;		// total delay
+	uint32_t duty_overruns;		// transmissions longer than the whole budget of a window
+	double duty_peak;			// peak utilisation of a window in percent
+} SCHED_queue;
+
+SCHED_queue *create_sched(void);
+void free_sched(SCHED_queue *q);
+int sched_set_dedup(SCHED_queue *q, uint32_t window_ms, uint32_t size);
+int sched_set_duty(SCHED_queue *q, double pct, uint32_t window_ms);
+double sched_duty(SCHED_queue *q, uint64_t now_ms);
+int sched_add(SCHED_queue *q, uint32_t capcode, uint32_t func, uint8_t *msg, int isNum, int priority, uint64_t arrival_ms, uint32_t deadline_ms);
+int sched_is_empty(SCHED_queue *q);
+int sched_next_tx(SCHED_queue *q, uint64_t *now_ms, uint32_t baud, int inv, uint32_t max_batches, POCSAG_tx **pp_tx);
@@ -0,0 +1,100 @@
+/*
+File:	pocsag_sweep.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Capcode sweep: tone-only address codewords of a capcode range packed into every frame slot they fit in,
+two per frame, i.e. 16 capcodes per batch, sent after a single preamble.
+Batches are generated one at a time into the same buffer, so memory doesn't depend on the range size.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pocsag2sdr.h"
+#include "pocsag_sweep.h"
+
+SWEEP_params *create_sweep(uint32_t first, uint32_t last, uint32_t func) {
+	SWEEP_params *sw;
+	int f;
+	if (first > last || last > SWEEP_MAX_CAPCODE) {
+		set_error(ERR_MSG, "Invalid capcode range %lu-%lu", (unsigned long)first, (unsigned long)last);
+		return NULL;
+	}
+	sw = calloc(1, sizeof(SWEEP_params));
+	if (sw == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return NULL;
+	}
+	sw->first = first;
+	sw->last = last;
+	sw->func = func & 3;
+	for (f = 0; f < 8; f++) {
+		uint64_t n;
+		sw->next[f] = first + ((f - first) & 7);
+		// every batch takes two capcodes of each frame
+		n = sw->next[f] <= last ? (last - sw->next[f]) / 8 + 1 : 0;
+		if ((n + 1) / 2 > sw->n_batches) sw->n_batches = (n + 1) / 2;
+	}
+	return sw;
+}
+
+// fills the codeword slots of the batch, returns the number of capcodes put into it
+static int fill_batch(SWEEP_params *sw, POCSAG_batch *btch) {
+	int slot, n = 0;
+	for (slot = 0; slot < 16; slot++) {
+		int f = slot / 2;
+		if (sw->next[f] <= sw->last) {
+			btch->data[slot + 1] = address_cw(sw->next[f], sw->func);
+			sw->slot_cap[slot] = sw->next[f];
+			sw->next[f] += 8;
+			n++;
+		} else {
+			btch->data[slot + 1] = CW_IDLE;
+			sw->slot_cap[slot] = SWEEP_NO_CAPCODE;
+		}
+	}
+	return n;
+}
+
+// sends the sweep with output_bit, or writes it as a codeword stream segment to cw_fp if output_bit is NULL;
+// every capcode is listed in the index with the time offset of its address codeword from the first bit
+int sweep_out(SWEEP_params *sw, POCSAG_tx *p_tx, int (*output_bit)(int bit), FILE *cw_fp, FILE *idx_fp, int verbose, FILE *log_fp) {
+	uint64_t bit0 = (uint64_t)p_tx->preamble_len * 32;
+	int n;
+
+	p_tx->n_batches = (uint32_t)sw->n_batches;
+	if (output_bit == NULL && write_cw_segment_header(cw_fp, p_tx) == (-1)) return (-1);
+	if (idx_fp != NULL) fprintf(idx_fp, "# capcode function seconds\n");
+	while ((n = fill_batch(sw, p_tx->first)) != 0) {
+		if (idx_fp != NULL) {
+			int slot;
+			for (slot = 0; slot < 16; slot++) {
+				uint64_t bit = bit0 + sw->batches_sent * 17 * 32 + (uint64_t)(slot + 1) * 32;
+				if (sw->slot_cap[slot] == SWEEP_NO_CAPCODE) continue;
+				fprintf(idx_fp, "%lu %lu %.6lf\n", (unsigned long)sw->slot_cap[slot], (unsigned long)sw->func, (double)bit / (double)p_tx->baud_rate);
+			}
+			if (ferror(idx_fp)) {
+				set_error(ERR_ERRNO, "[fprintf] Can't write sweep index");
+				return (-1);
+			}
+		}
+		if (output_bit == NULL) {
+			if (write_cw_batch(cw_fp, p_tx->first) == (-1)) return (-1);
+		} else {
+			if (pocsag_out(p_tx, output_bit, p_tx->inv, verbose, log_fp) == (-1)) return (-1);
+			// the following batches go on without preamble
+			p_tx->preamble_len = 0;
+			p_tx->cur_idx = p_tx->isEOL = 0;
+			p_tx->cur_btch = NULL;
+		}
+		sw->batches_sent++;
+		sw->capcodes_sent += n;
+		if (verbose && sw->batches_sent % 1000 == 0) {
+			fprintf(log_fp, "Sweep: %llu of %llu batches\r", (unsigned long long)sw->batches_sent, (unsigned long long)sw->n_batches);
+		}
+	}
+	return 0;
+}
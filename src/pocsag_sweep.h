@@ -0,0 +1,19 @@
+#include <stdint.h>
+#include <stdio.h>
+
+// POCSAG_tx comes from pocsag2sdr.h which must be included first
+
+#define	SWEEP_MAX_CAPCODE	0x1FFFFF	// 21 bit address
+#define	SWEEP_NO_CAPCODE	0xFFFFFFFF
+
+typedef struct SWEEP_params {
+	uint32_t first, last, func;
+	uint32_t next[8];			// next capcode of every frame, i.e. of every (capcode & 7)
+	uint32_t slot_cap[16];		// capcodes in the codeword slots of the current batch
+	uint64_t n_batches;			// batches the whole sweep takes
+	uint64_t batches_sent;
+	uint64_t capcodes_sent;
+} SWEEP_params;
+
+SWEEP_params *create_sweep(uint32_t first, uint32_t last, uint32_t func);
+int sweep_out(SWEEP_params *sw, POCSAG_tx *p_tx, int (*output_bit)(int bit), FILE *cw_fp, FILE *idx_fp, int verbose, FILE *log_fp);
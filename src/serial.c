@@ -6,6 +6,7 @@ This code can be freely used for any personal and non-commercial purposes provid
 For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
 */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -13,11 +14,15 @@ For any other purposes please contact me at e-mail above or any other e-mail lis
 // #include <Ntddser.h>
 
 #include "serial.h"
+#include "uart.h"
 #include "pocsag2sdr.h"
+#include "stats.h"
 
 static COM_params *com_p;
 
-int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTTinv, int KeepPTT ) {
+static int serial_write(uint8_t *buf, uint32_t len);
+
+int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTTinv, int KeepPTT, uint32_t uart_baud ) {
 	DCB dcb;
 	COMMTIMEOUTS cto;
 	// COMMCONFIG ccfg;
@@ -33,9 +38,12 @@ int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTT
 		return (-1);
 	}
 	com_p->ticks_per_bit = com_p->ticks_per_second.QuadPart / bps;
+	com_p->ticks_frac = com_p->ticks_per_second.QuadPart % bps;
+	com_p->bit_rate = bps;
 	com_p->PTTdelay = PTTdelay;
 	com_p->DtrRtsX = DtrRtsX;
 	com_p->PTTinv = PTTinv;
+	com_p->uart_baud = uart_baud;
 	if (DtrRtsX) {
 		com_p->BITon = SETRTS; com_p->BIToff = CLRRTS;
 		if (PTTinv) {
@@ -54,11 +62,11 @@ int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTT
 	}
 	com_p->serial_dev = CreateFile(tty_name,
 		// GENERIC_READ | GENERIC_WRITE,
-		0,
+		uart_baud ? GENERIC_WRITE : 0,
 		0,    // comm devices must be opened w/exclusive-access
 		NULL, // no security attributes
 		OPEN_EXISTING, // comm devices must use OPEN_EXISTING
-		0,    // not overlapped I/O
+		uart_baud ? FILE_FLAG_OVERLAPPED : 0,    // overlapped I/O in UART TX encoder mode only
 		NULL  // hTemplate must be NULL for comm devices
 	);
 
@@ -69,7 +77,7 @@ int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTT
 
 	memset(&dcb, 0, sizeof(DCB));
 	dcb.DCBlength = sizeof(DCB);
-	dcb.BaudRate = CBR_115200;
+	dcb.BaudRate = uart_baud ? uart_baud : CBR_115200;
 	dcb.fBinary = TRUE;
 	dcb.fParity = TRUE; dcb.Parity = NOPARITY;
 	dcb.fOutxCtsFlow = FALSE;
@@ -118,6 +126,22 @@ int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTT
 		return (-1);
 	}
 
+	if (uart_baud) {
+		int i;
+		for (i = 0; i < 2; i++) {
+			com_p->tx_ov[i].hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+			if (com_p->tx_ov[i].hEvent == NULL) {
+				set_error(ERR_WIN32, "[CreateEvent]");
+				CloseHandle(com_p->serial_dev);
+				return (-1);
+			}
+		}
+		if (init_uart(uart_baud, bps, serial_write) == (-1)) {
+			CloseHandle(com_p->serial_dev);
+			return (-1);
+		}
+	}
+
 	/* memset(&ccfg, 0, sizeof(COMMCONFIG));
 	ccfg.dwSize = sizeof(COMMCONFIG);
 	ccfg.wVersion = 1;
@@ -155,21 +179,130 @@ static void wait_end_of_bit(int64_t end_counter) {
 	} while (lCurrPC.QuadPart < end_counter);
 }
 
+// the bit being sent keeps its duration, the new rate applies from the next bit edge
+int serial_set_bit_rate(uint32_t bps) {
+	if (bps == 0) {
+		set_error(ERR_MSG, "Invalid bit rate");
+		return (-1);
+	}
+	if (com_p->uart_baud && uart_set_bit_rate(bps) == (-1)) return (-1);
+	com_p->ticks_per_bit = com_p->ticks_per_second.QuadPart / bps;
+	com_p->ticks_frac = com_p->ticks_per_second.QuadPart % bps;
+	com_p->bit_rate = bps;
+	com_p->frac_acc = 0;
+	return 0;
+}
+
+static void first_edge_sent(void) {
+	int64_t err;
+	QueryPerformanceCounter(&com_p->first_edge_ts);
+	if (com_p->target_ts == 0) return;
+	err = com_p->first_edge_ts.QuadPart - com_p->target_ts;
+	com_p->align_err_sum += err;
+	if (llabs(err) > llabs(com_p->align_err_max)) com_p->align_err_max = err;
+	com_p->aligned_keyings++;
+}
+
 int serial_output_bit(int bit) {
+	if (com_p->uart_baud) {
+		com_p->total_bits_sent++;
+		return uart_output_bit(bit);
+	}
 	wait_end_of_bit(com_p->next_bit_ts.QuadPart);
 	com_p->next_bit_ts.QuadPart += com_p->ticks_per_bit;
+	com_p->frac_acc += com_p->ticks_frac;
+	if (com_p->frac_acc >= com_p->bit_rate) {
+		com_p->next_bit_ts.QuadPart++;
+		com_p->frac_acc -= com_p->bit_rate;
+	}
 
 	if (!EscapeCommFunction(com_p->serial_dev, bit ? com_p->BITon : com_p->BIToff )) {
 		set_error(ERR_WIN32,"[EscapeCommFunction] Can't toggle DATA");
 		return (-1);
 	}
+	if (com_p->total_bits_sent == 0) first_edge_sent();
 
 	com_p->total_bits_sent++;
 
 	return 0;
 }
 
-int start_serial(void) {
+static int wait_write(int idx) {
+	DWORD written;
+	if (!com_p->tx_pending[idx]) return 0;
+	com_p->tx_pending[idx] = 0;
+	if (!GetOverlappedResult(com_p->serial_dev, &com_p->tx_ov[idx], &written, TRUE)) {
+		set_error(ERR_WIN32, "[GetOverlappedResult] Can't write DATA");
+		return (-1);
+	}
+	com_p->tx_bytes += written;
+	return 0;
+}
+
+// UART TX encoder mode: queue the encoded bytes while the previous write is still being sent
+static int serial_write(uint8_t *buf, uint32_t len) {
+	int idx = com_p->tx_idx;
+	STATS_START(t0);
+	if (wait_write(idx) == (-1)) return (-1);
+	if (len > com_p->tx_size[idx]) {
+		uint8_t *p = realloc(com_p->tx_buf[idx], len);
+		if (p == NULL) {
+			set_error(ERR_ERRNO, "[realloc]");
+			return (-1);
+		}
+		com_p->tx_buf[idx] = p;
+		com_p->tx_size[idx] = len;
+	}
+	memcpy(com_p->tx_buf[idx], buf, len);
+	if (com_p->tx_started && !(com_p->tx_pending[idx ^ 1] && !HasOverlappedIoCompleted(&com_p->tx_ov[idx ^ 1]))) {
+		// the line has gone idle between the writes
+		com_p->tx_underruns++;
+	}
+	com_p->tx_ov[idx].Offset = com_p->tx_ov[idx].OffsetHigh = 0;
+	if (!WriteFile(com_p->serial_dev, com_p->tx_buf[idx], len, NULL, &com_p->tx_ov[idx]) && GetLastError() != ERROR_IO_PENDING) {
+		set_error(ERR_WIN32, "[WriteFile] Can't write DATA");
+		return (-1);
+	}
+	com_p->tx_pending[idx] = 1;
+	if (!com_p->tx_started) first_edge_sent();
+	com_p->tx_started = 1;
+	com_p->tx_idx = idx ^ 1;
+	STATS_STOP(STAGE_WRITE, t0, len, 0);
+	return 0;
+}
+
+// Sleep() may wake up a whole timer tick late at the default timer resolution, so it's only used while more than
+// SERIAL_SPIN_MS are left and the rest is spun. Returns how late it is in ticks, negative if ts had passed already
+static int64_t wait_until(int64_t ts) {
+	LARGE_INTEGER now;
+	int64_t spin = com_p->ticks_per_second.QuadPart * SERIAL_SPIN_MS / 1000;
+	QueryPerformanceCounter(&now);
+	if (now.QuadPart > ts) return ts - now.QuadPart;
+	if (ts - now.QuadPart > spin) {
+		Sleep((DWORD)((ts - now.QuadPart - spin) * 1000 / com_p->ticks_per_second.QuadPart));
+	}
+	do {
+		QueryPerformanceCounter(&now);
+	} while (now.QuadPart < ts);
+	return now.QuadPart - ts;
+}
+
+// maps an absolute time in nanoseconds since 1970-01-01 UTC to the performance counter
+int64_t serial_epoch_ticks(int64_t epoch_ns) {
+	LARGE_INTEGER t0, t1;
+	FILETIME ft;
+	int64_t now_ns;
+	QueryPerformanceCounter(&t0);
+	GetSystemTimePreciseAsFileTime(&ft);
+	QueryPerformanceCounter(&t1);
+	// FILETIME counts 100 ns intervals since 1601-01-01
+	now_ns = ((int64_t)(((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime) - 116444736000000000LL) * 100;
+	return (t0.QuadPart + t1.QuadPart) / 2 + (int64_t)((double)(epoch_ns - now_ns) * (double)com_p->ticks_per_second.QuadPart / 1e9);
+}
+
+// first_edge_ts is the performance counter value to send the first bit edge at, PTT is keyed PTT delay before it;
+// 0 sends at once
+int start_serial(int64_t first_edge_ts) {
 	/* ULONG ulRts;
 	DWORD dwBytesReturned;
 	if (!DeviceIoControl(com_p->serial_dev, IOCTL_SERIAL_GET_MODEM_CONTROL, NULL, 0, &ulRts, sizeof(ULONG), &dwBytesReturned, NULL)) {
@@ -178,14 +311,41 @@ int start_serial(void) {
 	}
 	printf("MCR=%lx\n", ulRts); */
 	com_p->total_bits_sent = 0;
+	com_p->tx_started = 0;
+	com_p->target_ts = first_edge_ts;
+	if (first_edge_ts && wait_until(first_edge_ts - (int64_t)com_p->PTTdelay * com_p->ticks_per_second.QuadPart / 1000) < 0) {
+		// keyed late, the first bit edge is still waited for but the transmitter may not be up yet
+		com_p->ptt_misses++;
+	}
 	if (!EscapeCommFunction(com_p->serial_dev, com_p->PTTon)) {
 		set_error(ERR_WIN32, "[EscapeCommFunction] Can't toggle PTT");
 		return (-1);
 	}
-	Sleep(com_p->PTTdelay);
-	com_p->dwStart = GetTickCount();
-	QueryPerformanceCounter(&com_p->first_bit_ts);
-	com_p->next_bit_ts.QuadPart = (com_p->first_bit_ts.QuadPart += com_p->ticks_per_bit);
+	QueryPerformanceCounter(&com_p->ptt_on_ts);
+	if (first_edge_ts) {
+		// UART writes go out as soon as queued, so wait here rather than in serial_output_bit
+		int64_t late = wait_until(first_edge_ts);
+		com_p->dwStart = GetTickCount();
+		if (late < 0) {
+			// a missed edge isn't an overshoot of the wait; the bits follow a full PTT delay after keying
+			// rather than catching up with the schedule in a burst
+			com_p->edge_misses++;
+			com_p->first_bit_ts.QuadPart = com_p->ptt_on_ts.QuadPart + (int64_t)com_p->PTTdelay * com_p->ticks_per_second.QuadPart / 1000;
+			if (wait_until(com_p->first_bit_ts.QuadPart) < 0) QueryPerformanceCounter(&com_p->first_bit_ts);
+		} else {
+			com_p->wait_late_sum += late;
+			if (late > com_p->wait_late_max) com_p->wait_late_max = late;
+			com_p->timed_waits++;
+			com_p->first_bit_ts.QuadPart = first_edge_ts;
+		}
+	} else {
+		Sleep(com_p->PTTdelay);
+		com_p->dwStart = GetTickCount();
+		QueryPerformanceCounter(&com_p->first_bit_ts);
+		com_p->first_bit_ts.QuadPart += com_p->ticks_per_bit;
+	}
+	com_p->next_bit_ts.QuadPart = com_p->first_bit_ts.QuadPart;
+	com_p->frac_acc = 0;
 
 	return 0;
 }
@@ -193,10 +353,25 @@ int start_serial(void) {
 int end_serial(void) {
 	// DWORD dwBytesReturned;
 	// ULONG ulRts = SERIAL_IOC_MCR_RTS;
-	wait_end_of_bit(com_p->next_bit_ts.QuadPart);
+	int rc = 0;
+	if (com_p->uart_baud) {
+		// keep PTT on until the UART has shifted out the last byte
+		if (end_uart() == (-1) || wait_write(com_p->tx_idx ^ 1) == (-1) || wait_write(com_p->tx_idx) == (-1)) {
+			rc = (-1);
+		} else if (!FlushFileBuffers(com_p->serial_dev)) {
+			set_error(ERR_WIN32, "[FlushFileBuffers]");
+			rc = (-1);
+		}
+	} else {
+		wait_end_of_bit(com_p->next_bit_ts.QuadPart);
+	}
 	QueryPerformanceCounter(&com_p->last_bit_ts);
 	com_p->dwEnd = GetTickCount();
 	EscapeCommFunction(com_p->serial_dev, com_p->PTToff);
+	com_p->keyed_ticks += com_p->last_bit_ts.QuadPart - com_p->ptt_on_ts.QuadPart;
+	com_p->all_bits_sent += com_p->total_bits_sent;
+	com_p->bit_ticks += com_p->last_bit_ts.QuadPart - com_p->first_bit_ts.QuadPart;
+	com_p->keyings++;
 	// DeviceIoControl(com_p->serial_dev, IOCTL_SERIAL_SET_RTS, NULL, 0, NULL, 0, &dwBytesReturned, NULL);
 	/* if (!DeviceIoControl(com_p->serial_dev, IOCTL_SERIAL_GET_MODEM_CONTROL, NULL, 0, &ulRts, sizeof(ULONG), &dwBytesReturned, NULL)) {
 		set_error(ERR_WIN32, "[DeviceIoControl] Can't do IOCTL_SERIAL_GET_MODEM_CONTROL");
@@ -210,5 +385,5 @@ int end_serial(void) {
 	} */
 	// Sleep(3000);
 	// CloseHandle(com_p->serial_dev);
-	return 0;
+	return rc;
 }
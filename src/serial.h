@@ -1,10 +1,15 @@
 #include <stdint.h>
 #include <windows.h>
 
+#define	SERIAL_SPIN_MS	20	// spin rather than Sleep() for the last 20 ms, more than one 15.6 ms timer tick
+
 typedef struct COM_params {
 	HANDLE serial_dev;
 	LARGE_INTEGER ticks_per_second;
 	uint64_t ticks_per_bit;
+	uint32_t bit_rate;
+	uint64_t ticks_frac;		// ticks_per_second % bit_rate, spread over the bits so there's no drift
+	uint64_t frac_acc;
 	int PTTdelay,PTTinv;
 	int DtrRtsX;
 	DWORD PTTon, PTToff;
@@ -15,11 +20,37 @@ typedef struct COM_params {
 	uint32_t total_bits_sent;
 	uint32_t bits_with_delays;
 	uint64_t max_delay;
+	LARGE_INTEGER ptt_on_ts;
+	uint64_t keyed_ticks;		// PTT on time over all keyings, including PTT delays
+	uint64_t all_bits_sent;		// bits sent over all keyings
+	uint64_t bit_ticks;			// from the first bit to the end of the last one, over all keyings
+	uint32_t keyings;
 	DWORD dwStart, dwEnd;
+	// UART TX encoder mode, the bit stream is written to TXD
+	uint32_t uart_baud;			// 0 if DTR/RTS bit-banging is used
+	OVERLAPPED tx_ov[2];		// two writes in flight keep the UART busy while the next one is queued
+	uint8_t *tx_buf[2];
+	uint32_t tx_size[2];
+	int tx_pending[2];
+	int tx_idx;
+	int tx_started;				// a write has been queued since the last start_serial
+	uint64_t tx_bytes;
+	uint32_t tx_underruns;		// previous write had completed before the next one was queued
+	// time-aligned start
+	int64_t target_ts;			// scheduled first bit edge, 0 if sent at once
+	LARGE_INTEGER first_edge_ts;	// when the first bit edge has actually been sent
+	int64_t align_err_sum, align_err_max;	// ticks, over aligned keyings
+	uint32_t aligned_keyings;
+	int64_t wait_late_sum, wait_late_max;	// ticks the wait for the first bit edge has overshot it by
+	uint32_t timed_waits;		// waits which have reached the first bit edge in time
+	uint32_t ptt_misses;		// keyings which PTT moment had already passed
+	uint32_t edge_misses;		// keyings which first bit edge had already passed after PTT delay
 } COM_params;
 
-int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTTinv, int KeepPTT );
+int init_serial(char *tty_name, uint32_t bps, int PTTdelay, int DtrRtsX, int PTTinv, int KeepPTT, uint32_t uart_baud );
 COM_params *get_serial_params(void);
+int serial_set_bit_rate(uint32_t bps);
 int serial_output_bit(int bit);
-int start_serial(void);
+int64_t serial_epoch_ticks(int64_t epoch_ns);
+int start_serial(int64_t first_edge_ts);
 int end_serial(void);
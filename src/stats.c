@@ -0,0 +1,126 @@
+/*
+File:	stats.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include "stats.h"
+
+#ifdef POCSAG_STATS
+
+#include <string.h>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif // WIN32
+
+static STAGE_stats stages[STAGE_MAX];
+static char *stage_names[STAGE_MAX] = { "setup", "recode", "add_message", "bch", "output", "synth", "write" };
+// stage which wall time includes the given one, (-1) for top level stages
+static int stage_parent[STAGE_MAX] = { -1, -1, -1, STAGE_ADD_MESSAGE, -1, STAGE_OUTPUT, -1 };
+
+static struct {
+	char *name;
+	double value;
+} counters[STATS_MAX_COUNTERS];
+static int n_counters;
+
+static char *run_mode = "";
+static uint32_t run_sample_rate, run_baud_rate;
+static uint64_t first_ticks;
+
+static uint64_t ticks_per_second(void) {
+#ifdef WIN32
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	return f.QuadPart;
+#else
+	return 1000000000ull;
+#endif // WIN32
+}
+
+uint64_t stats_ticks(void) {
+	uint64_t t;
+#ifdef WIN32
+	LARGE_INTEGER pc;
+	QueryPerformanceCounter(&pc);
+	t = pc.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif // WIN32
+	if (first_ticks == 0) first_ticks = t;
+	return t;
+}
+
+void stats_add(int stage, uint64_t start_ticks, uint64_t bytes, uint64_t samples) {
+	STAGE_stats *s = &stages[stage];
+	s->ticks += stats_ticks() - start_ticks;
+	s->calls++;
+	s->bytes += bytes;
+	s->samples += samples;
+}
+
+// totals measured elsewhere, e.g. by another thread which mustn't call stats_add()
+void stats_add_ticks(int stage, uint64_t ticks, uint64_t calls, uint64_t bytes, uint64_t samples) {
+	STAGE_stats *s = &stages[stage];
+	s->ticks += ticks;
+	s->calls += calls;
+	s->bytes += bytes;
+	s->samples += samples;
+}
+
+void stats_alloc(int stage) {
+	stages[stage].allocs++;
+}
+
+void stats_run_info(char *mode, uint32_t sample_rate, uint32_t baud_rate) {
+	run_mode = mode;
+	run_sample_rate = sample_rate;
+	run_baud_rate = baud_rate;
+}
+
+void stats_counter(char *name, double value) {
+	int i;
+	for (i = 0; i < n_counters; i++) {
+		if (!strcmp(counters[i].name, name)) break;
+	}
+	if (i == n_counters) {
+		if (n_counters == STATS_MAX_COUNTERS) return;
+		counters[n_counters++].name = name;
+	}
+	counters[i].value = value;
+}
+
+void stats_dump(FILE *fp) {
+	double tps = (double)ticks_per_second();
+	uint64_t self_ticks[STAGE_MAX];
+	int i;
+
+	for (i = 0; i < STAGE_MAX; i++) self_ticks[i] = stages[i].ticks;
+	for (i = 0; i < STAGE_MAX; i++) {
+		if (stage_parent[i] >= 0) self_ticks[stage_parent[i]] -= stages[i].ticks;
+	}
+
+	fprintf(fp, "{\"mode\":\"%s\",\"sample_rate\":%lu,\"baud_rate\":%lu,\"wall_seconds\":%.6f,\"stages\":{",
+		run_mode, (unsigned long)run_sample_rate, (unsigned long)run_baud_rate,
+		first_ticks ? (double)(stats_ticks() - first_ticks) / tps : 0.0);
+	for (i = 0; i < STAGE_MAX; i++) {
+		STAGE_stats *s = &stages[i];
+		fprintf(fp, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.6f,\"self_seconds\":%.6f,\"bytes\":%llu,\"samples\":%llu,\"allocs\":%llu}",
+			i ? "," : "", stage_names[i], (unsigned long long)s->calls, (double)s->ticks / tps, (double)(int64_t)self_ticks[i] / tps,
+			(unsigned long long)s->bytes, (unsigned long long)s->samples, (unsigned long long)s->allocs);
+	}
+	fprintf(fp, "},\"counters\":{");
+	for (i = 0; i < n_counters; i++) {
+		fprintf(fp, "%s\"%s\":%.9g", i ? "," : "", counters[i].name, counters[i].value);
+	}
+	fprintf(fp, "}}\n");
+}
+
+#endif // POCSAG_STATS
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-stage hot-path counters; compiled in only when POCSAG_STATS is defined
+enum {
+	STAGE_SETUP=0,
+	STAGE_RECODE,
+	STAGE_ADD_MESSAGE,
+	STAGE_BCH,			// nested in STAGE_ADD_MESSAGE
+	STAGE_OUTPUT,		// get_cws + pocsag_out, includes STAGE_SYNTH
+	STAGE_SYNTH,
+	STAGE_WRITE,		// writer thread time, added by end_writer(), or COM port UART writes; overlaps STAGE_SYNTH
+	STAGE_MAX
+};
+
+#define	STATS_MAX_COUNTERS	32
+
+typedef struct STAGE_stats {
+	uint64_t calls;
+	uint64_t ticks;
+	uint64_t bytes;
+	uint64_t samples;
+	uint64_t allocs;
+} STAGE_stats;
+
+#ifdef POCSAG_STATS
+
+uint64_t stats_ticks(void);
+void stats_add(int stage, uint64_t start_ticks, uint64_t bytes, uint64_t samples);
+void stats_add_ticks(int stage, uint64_t ticks, uint64_t calls, uint64_t bytes, uint64_t samples);
+void stats_alloc(int stage);
+void stats_run_info(char *mode, uint32_t sample_rate, uint32_t baud_rate);
+void stats_counter(char *name, double value);
+void stats_dump(FILE *fp);
+
+#define	STATS_START(v)						uint64_t v = stats_ticks()
+#define	STATS_STOP(stage, v, bytes, samples)	stats_add(stage, v, bytes, samples)
+#define	STATS_ADD(stage, ticks, calls, bytes, samples)	stats_add_ticks(stage, ticks, calls, bytes, samples)
+#define	STATS_ALLOC(stage)					stats_alloc(stage)
+#define	STATS_RUN_INFO(mode, sr, bps)		stats_run_info(mode, sr, bps)
+#define	STATS_COUNTER(name, value)			stats_counter(name, value)
+#define	STATS_DUMP(fp)						stats_dump(fp)
+
+#else
+
+#define	STATS_START(v)
+#define	STATS_STOP(stage, v, bytes, samples)
+#define	STATS_ADD(stage, ticks, calls, bytes, samples)
+#define	STATS_ALLOC(stage)
+#define	STATS_RUN_INFO(mode, sr, bps)
+#define	STATS_COUNTER(name, value)
+#define	STATS_DUMP(fp)
+
+#endif // POCSAG_STATS
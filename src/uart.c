@@ -0,0 +1,145 @@
+/*
+File:	uart.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+UART TX encoder: the POCSAG bit stream is sent on the TXD line at an oversampled UART baud rate,
+so bit timing comes from the UART clock instead of a CPU busy-loop.
+Every POCSAG bit is spread over the UART bit periods which centres fall inside it; start and stop bits
+can't be controlled, so they show up as short glitches where they disagree with the wanted level.
+The line level follows DTR mode: POCSAG '1' is the positive voltage, i.e. logical 0 (space) on TXD.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "uart.h"
+#include "my_strerror.h"
+#include "stats.h"
+
+static UART_params *uart_p;
+
+int init_uart(uint32_t uart_baud, uint32_t bps, int (*sink)(uint8_t *buf, uint32_t len)) {
+	if (bps == 0 || uart_baud < 2 * bps * UART_CHAR_BITS / 8) {
+		set_error(ERR_MSG, "UART baud rate %lu is too low for %lu bps", (unsigned long)uart_baud, (unsigned long)bps);
+		return (-1);
+	}
+	uart_p = calloc(1, sizeof(UART_params));
+	if (uart_p == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	uart_p->uart_baud = uart_baud;
+	uart_p->bit_rate = bps;
+	uart_p->sink = sink;
+	// one batch worth of characters plus some room for rounding
+	uart_p->size = (uint32_t)((uint64_t)UART_BATCH_BITS * uart_baud / bps / UART_CHAR_BITS) + 16;
+	uart_p->buf = malloc(uart_p->size);
+	if (uart_p->buf == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	uart_p->level = 1;	// idle line is mark
+	uart_p->edge_err_min = HUGE_VAL;
+	uart_p->edge_err_max = -HUGE_VAL;
+	return 0;
+}
+
+int uart_set_bit_rate(uint32_t bps) {
+	uint32_t size;
+	uint8_t *buf;
+	if (bps == 0 || uart_p->uart_baud < 2 * bps * UART_CHAR_BITS / 8) {
+		set_error(ERR_MSG, "UART baud rate %lu is too low for %lu bps", (unsigned long)uart_p->uart_baud, (unsigned long)bps);
+		return (-1);
+	}
+	uart_p->bit_rate = bps;
+	size = (uint32_t)((uint64_t)UART_BATCH_BITS * uart_p->uart_baud / bps / UART_CHAR_BITS) + 16;
+	if (size > uart_p->size) {
+		buf = realloc(uart_p->buf, size);
+		if (buf == NULL) {
+			set_error(ERR_ERRNO, "[realloc]");
+			return (-1);
+		}
+		uart_p->buf = buf;
+		uart_p->size = size;
+	}
+	return 0;
+}
+
+// the sink accounts for its writes, the file sink in the writer thread
+static int flush_uart(void) {
+	uart_p->bits_in_buf = 0;
+	if (uart_p->len == 0) return 0;
+	if (uart_p->sink(uart_p->buf, uart_p->len) == (-1)) return (-1);
+	uart_p->len = 0;
+	return 0;
+}
+
+int uart_output_bit(int bit) {
+	int level = !bit;
+	double bit_end = uart_p->bit_start + (double)uart_p->uart_baud / (double)uart_p->bit_rate;
+	// UART bit periods [k, k+1) which centres lie inside [bit_start, bit_end)
+	uint64_t k_end = (uint64_t)ceil(bit_end - 0.5);
+	int edge = (level != uart_p->level);
+	STATS_START(t0);
+
+	for (; uart_p->uart_bits < k_end; uart_p->uart_bits++) {
+		int pos = (int)(uart_p->uart_bits % UART_CHAR_BITS);
+		int out;
+		if (pos == 0) {
+			out = 0;	// start bit
+			uart_p->cur_char = 0;
+		} else if (pos == UART_CHAR_BITS - 1) {
+			out = 1;	// stop bit
+			if (uart_p->len == uart_p->size && flush_uart() == (-1)) return (-1);
+			uart_p->buf[uart_p->len++] = uart_p->cur_char;
+		} else {
+			out = level;
+			uart_p->cur_char |= (uint8_t)(level << (pos - 1));
+		}
+		if (out != level) uart_p->forced_bits++;
+		if (edge && out == level) {
+			double err = (double)uart_p->uart_bits - uart_p->bit_start;
+			uart_p->edges++;
+			uart_p->edge_err_sum += err;
+			uart_p->edge_err_sq_sum += err * err;
+			if (err < uart_p->edge_err_min) uart_p->edge_err_min = err;
+			if (err > uart_p->edge_err_max) uart_p->edge_err_max = err;
+			edge = 0;
+		}
+	}
+	uart_p->level = level;
+	uart_p->bit_start = bit_end;
+	uart_p->total_bits_sent++;
+	STATS_STOP(STAGE_SYNTH, t0, 0, 0);
+
+	// one write per batch keeps the UART busy without per-bit system calls
+	if (++uart_p->bits_in_buf == UART_BATCH_BITS) return flush_uart();
+	return 0;
+}
+
+// ends a transmission, the next bit starts a new character
+int end_uart(void) {
+	// complete the last character with idle (mark) data bits
+	while (uart_p->uart_bits % UART_CHAR_BITS != 0) {
+		int pos = (int)(uart_p->uart_bits % UART_CHAR_BITS);
+		if (pos == UART_CHAR_BITS - 1) {
+			if (uart_p->len == uart_p->size && flush_uart() == (-1)) return (-1);
+			uart_p->buf[uart_p->len++] = uart_p->cur_char;
+		} else if (pos != 0) {
+			uart_p->cur_char |= (uint8_t)(1 << (pos - 1));
+		}
+		uart_p->uart_bits++;
+	}
+	uart_p->bit_start = (double)uart_p->uart_bits;
+	uart_p->level = 1;
+	return flush_uart();
+}
+
+UART_params *get_uart_params(void) {
+	return uart_p;
+}
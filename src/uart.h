@@ -0,0 +1,33 @@
+#include <stdint.h>
+
+#define	UART_CHAR_BITS	10		// start bit, 8 data bits, stop bit
+#define	UART_BATCH_BITS	(17*32)	// POCSAG bits collected before one write
+
+typedef struct UART_params {
+	// initial parameters
+	uint32_t uart_baud;		// UART line rate
+	uint32_t bit_rate;		// POCSAG bit rate
+	int (*sink)(uint8_t *buf, uint32_t len);
+
+	// encoder state
+	double bit_start;		// ideal start of the current POCSAG bit in UART bit periods
+	uint64_t uart_bits;		// UART bit periods generated so far
+	uint8_t cur_char;
+	int level;				// wanted level of the previous POCSAG bit
+	uint8_t *buf;
+	uint32_t len, size;
+	uint32_t bits_in_buf;	// POCSAG bits in the buffer
+
+	// timing statistics, errors are in UART bit periods
+	uint64_t total_bits_sent;
+	uint64_t forced_bits;	// start/stop bits opposite to the wanted level
+	uint64_t edges;
+	double edge_err_sum, edge_err_sq_sum;
+	double edge_err_min, edge_err_max;
+} UART_params;
+
+int init_uart(uint32_t uart_baud, uint32_t bps, int (*sink)(uint8_t *buf, uint32_t len));
+int uart_set_bit_rate(uint32_t bps);
+int uart_output_bit(int bit);
+int end_uart(void);
+UART_params *get_uart_params(void);
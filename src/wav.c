@@ -0,0 +1,246 @@
+/*
+File:	wav.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Baseband NRZ audio for transmitters with a 2-level FSK data input: 16 bit mono samples written as a WAV file
+or raw PCM. Bit edges keep exact fractional timing, a sample crossed by an edge gets the average level over it,
+so there's no drift at any bit rate to sample rate ratio.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define	_USE_MATH_DEFINES
+#include <math.h>
+
+#include "wav.h"
+#include "writer.h"
+#include "my_strerror.h"
+#include "stats.h"
+
+static WAV_params *wav_p;
+static uint32_t skip;	// filter delay, first outputs are dropped to keep bit edges in place
+
+static void put_u16(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static void make_header(uint8_t *hdr, uint32_t sample_rate, uint32_t data_len) {
+	memcpy(hdr, "RIFF", 4);
+	put_u32(hdr + 4, data_len == 0xFFFFFFFF ? data_len : data_len + WAV_HDR_LEN - 8);
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	put_u32(hdr + 16, 16);
+	put_u16(hdr + 20, 1);					// PCM
+	put_u16(hdr + 22, 1);					// mono
+	put_u32(hdr + 24, sample_rate);
+	put_u32(hdr + 28, sample_rate * 2);		// bytes per second
+	put_u16(hdr + 32, 2);					// bytes per sample
+	put_u16(hdr + 34, 16);					// bits per sample
+	memcpy(hdr + 36, "data", 4);
+	put_u32(hdr + 40, data_len);
+}
+
+// windowed sinc with Blackman window, about four periods of the cut-off frequency long
+static int make_filter(void) {
+	uint32_t i;
+	double sum = 0;
+	wav_p->n_taps = (uint32_t)(4.0 * wav_p->sample_rate / wav_p->lpf) | 1;
+	if (wav_p->n_taps < 3) wav_p->n_taps = 3;
+	wav_p->taps = malloc(wav_p->n_taps * sizeof(double));
+	if (wav_p->taps == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	wav_p->hist = calloc(2 * wav_p->n_taps, sizeof(double));
+	if (wav_p->hist == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	for (i = 0; i < wav_p->n_taps; i++) {
+		double n = (double)i - (double)(wav_p->n_taps - 1) / 2;
+		double x = 2.0 * wav_p->lpf / wav_p->sample_rate;
+		double w = 0.42 - 0.5 * cos(2 * M_PI * i / (wav_p->n_taps - 1)) + 0.08 * cos(4 * M_PI * i / (wav_p->n_taps - 1));
+		wav_p->taps[i] = w * (n == 0 ? x : sin(M_PI * x * n) / (M_PI * n));
+		sum += wav_p->taps[i];
+	}
+	for (i = 0; i < wav_p->n_taps; i++) wav_p->taps[i] /= sum;
+	skip = (wav_p->n_taps - 1) / 2;
+	return 0;
+}
+
+int init_wav(char *file_name, uint32_t sample_rate, uint32_t bps, uint32_t ampl, uint32_t lpf, int header) {
+	STATS_START(t0);
+
+	if (bps == 0 || sample_rate == 0) {
+		set_error(ERR_MSG, "Invalid bit rate or sample rate");
+		return (-1);
+	}
+	if (lpf != 0 && 2 * lpf >= sample_rate) {
+		set_error(ERR_MSG, "Low-pass filter cut-off %lu Hz must be below half of the sample rate", (unsigned long)lpf);
+		return (-1);
+	}
+	wav_p = calloc(1, sizeof(WAV_params));
+	if (wav_p == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+
+	wav_p->sample_rate = sample_rate;
+	wav_p->bit_rate = bps;
+	wav_p->ampl = ampl > 32767 ? 32767 : ampl;
+	wav_p->lpf = lpf;
+	wav_p->header = header;
+	wav_p->file_name = file_name;
+	skip = 0;
+	if (lpf != 0 && make_filter() == (-1)) return (-1);
+
+	if (header) {
+		uint8_t hdr[WAV_HDR_LEN];
+		// the sizes are patched at the end, a stream to stdout keeps the "unknown length" ones
+		make_header(hdr, sample_rate, 0xFFFFFFFF);
+		if (writer_write(hdr, sizeof(hdr)) == (-1)) return (-1);
+	}
+	QueryPerformanceFrequency(&wav_p->ticks_per_second);
+	QueryPerformanceCounter(&wav_p->start_ts);
+	STATS_STOP(STAGE_SETUP, t0, 0, 0);
+	return 0;
+}
+
+// the current sample keeps its covered part, units are rescaled to the new bit rate
+int wav_set_bit_rate(uint32_t bps) {
+	if (bps == 0) {
+		set_error(ERR_MSG, "Invalid bit rate");
+		return (-1);
+	}
+	wav_p->fill = (uint32_t)((uint64_t)wav_p->fill * bps / wav_p->bit_rate);
+	wav_p->part = wav_p->part * (int64_t)bps / (int64_t)wav_p->bit_rate;
+	wav_p->bit_rate = bps;
+	return 0;
+}
+
+static int put_sample(double x) {
+	double y = x;
+	long v;
+	wav_p->in_samples++;
+	if (wav_p->n_taps) {
+		uint32_t i;
+		double *h;
+		// history is stored twice, so the last n_taps samples are always contiguous
+		wav_p->hist[wav_p->hist_idx] = wav_p->hist[wav_p->hist_idx + wav_p->n_taps] = x;
+		h = wav_p->hist + wav_p->hist_idx + 1;
+		if (++wav_p->hist_idx == wav_p->n_taps) wav_p->hist_idx = 0;
+		y = 0;
+		for (i = 0; i < wav_p->n_taps; i++) y += wav_p->taps[i] * h[i];
+		if (skip) {
+			skip--;
+			return 0;
+		}
+	}
+	v = lrint(y * wav_p->ampl);
+	if (v > 32767) v = 32767;
+	if (v < -32768) v = -32768;
+	wav_p->block[wav_p->block_len++] = (int16_t)v;
+	wav_p->samples++;
+	if (wav_p->block_len == WAV_BLOCK_SAMPLES) {
+		// little-endian samples as they are in memory
+		if (writer_write((uint8_t *)wav_p->block, wav_p->block_len * sizeof(int16_t)) == (-1)) return (-1);
+		wav_p->block_len = 0;
+	}
+	return 0;
+}
+
+// starts the next bit <offset> samples after the beginning of the output with silence before it,
+// e.g. the first bit of a file or the next queued transmission; an offset already passed starts the bit right away
+int wav_start_offset(double offset) {
+	uint64_t n = (uint64_t)floor(offset);
+	uint32_t fill;
+	if (n < wav_p->in_samples) return 0;
+	if (n > wav_p->in_samples && wav_p->fill != 0) {
+		// the rest of a partly covered sample is silent
+		if (put_sample((double)wav_p->part / (double)wav_p->bit_rate) == (-1)) return (-1);
+		wav_p->fill = 0;
+		wav_p->part = 0;
+	}
+	while (wav_p->in_samples < n) {
+		if (put_sample(0) == (-1)) return (-1);
+	}
+	fill = (uint32_t)lrint((offset - (double)n) * wav_p->bit_rate);
+	if (fill >= wav_p->bit_rate) fill = wav_p->bit_rate - 1;
+	if (fill > wav_p->fill) wav_p->fill = fill;
+	return 0;
+}
+
+int wav_output_bit(int bit) {
+	int level = bit ? -1 : 1;	// '1' is the lower frequency, as in I/Q output
+	uint32_t left = wav_p->sample_rate;
+#ifdef POCSAG_STATS
+	uint64_t samples = wav_p->samples;
+#endif // POCSAG_STATS
+	STATS_START(t0);
+	while (left != 0) {
+		uint32_t n = wav_p->bit_rate - wav_p->fill;
+		if (n > left) n = left;
+		wav_p->part += (int64_t)level * n;
+		wav_p->fill += n;
+		left -= n;
+		if (wav_p->fill == wav_p->bit_rate) {
+			if (put_sample((double)wav_p->part / (double)wav_p->bit_rate) == (-1)) return (-1);
+			wav_p->fill = 0;
+			wav_p->part = 0;
+		}
+	}
+	STATS_STOP(STAGE_SYNTH, t0, (wav_p->samples - samples) * 2, wav_p->samples - samples);
+	return 0;
+}
+
+int end_wav(void) {
+	LARGE_INTEGER now;
+	FILE *fp;
+	uint8_t hdr[WAV_HDR_LEN];
+	uint32_t i;
+
+	// the last partial sample and the filter tail complete the final bit
+	if (wav_p->fill != 0 && put_sample((double)wav_p->part / (double)wav_p->bit_rate) == (-1)) return (-1);
+	for (i = 0; i < (wav_p->n_taps ? (wav_p->n_taps - 1) / 2 : 0); i++) {
+		if (put_sample(0) == (-1)) return (-1);
+	}
+	if (wav_p->block_len != 0 && writer_write((uint8_t *)wav_p->block, wav_p->block_len * sizeof(int16_t)) == (-1)) return (-1);
+	wav_p->block_len = 0;
+	if (end_writer() == (-1)) return (-1);
+	QueryPerformanceCounter(&now);
+	wav_p->render_ticks = now.QuadPart - wav_p->start_ts.QuadPart;
+
+	if (!wav_p->header || !strcmp(wav_p->file_name, "-")) return 0;
+	make_header(hdr, wav_p->sample_rate, (uint32_t)(wav_p->samples * 2));
+	fp = fopen(wav_p->file_name, "r+b");
+	if (fp == NULL) {
+		set_error(ERR_ERRNO, "[fopen] Can't update WAV header of '%s'", wav_p->file_name);
+		return (-1);
+	}
+	if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+		set_error(ERR_ERRNO, "[fwrite] Can't update WAV header of '%s'", wav_p->file_name);
+		fclose(fp);
+		return (-1);
+	}
+	if (fclose(fp) == EOF) {
+		set_error(ERR_ERRNO, "[fclose] Can't update WAV header of '%s'", wav_p->file_name);
+		return (-1);
+	}
+	return 0;
+}
+
+WAV_params *get_wav_params(void) {
+	return wav_p;
+}
@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <windows.h>
+
+#define	WAV_HDR_LEN			44
+#define	WAV_SAMPLE_RATE		48000	// default sample rate of audio output
+#define	WAV_AMPLITUDE		16384	// default peak level of 16 bit samples
+#define	WAV_BLOCK_SAMPLES	4096	// samples collected before being passed to the writer
+
+typedef struct WAV_params {
+	// initial parameters
+	uint32_t sample_rate;
+	uint32_t bit_rate;
+	uint32_t ampl;
+	uint32_t lpf;			// low-pass filter cut-off in Hz, 0 if not filtered
+	int header;				// WAV header, otherwise raw PCM
+	char *file_name;
+
+	// NRZ with exact fractional bit timing; a bit lasts sample_rate units of 1/bit_rate sample
+	uint32_t fill;			// units of the current sample covered so far
+	int64_t part;			// sum of levels over these units
+
+	// low-pass FIR filter
+	double *taps;
+	double *hist;			// circular history of unfiltered samples
+	uint32_t n_taps, hist_idx;
+
+	int16_t block[WAV_BLOCK_SAMPLES];
+	uint32_t block_len;
+	uint64_t samples;
+	uint64_t in_samples;	// samples before the filter, i.e. the position in the output
+	LARGE_INTEGER ticks_per_second, start_ts;
+	uint64_t render_ticks;
+} WAV_params;
+
+int init_wav(char *file_name, uint32_t sample_rate, uint32_t bps, uint32_t ampl, uint32_t lpf, int header);
+int wav_set_bit_rate(uint32_t bps);
+int wav_start_offset(double offset);
+int wav_output_bit(int bit);
+int end_wav(void);
+WAV_params *get_wav_params(void);
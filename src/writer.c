@@ -0,0 +1,214 @@
+/*
+File:	writer.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "writer.h"
+#include "my_strerror.h"
+#include "stats.h"
+
+static WRITER_params *wr_p;
+
+static DWORD WINAPI writer_thread(LPVOID arg) {
+	for (;;) {
+		LARGE_INTEGER t0, t1;
+		uint32_t len, wlen, done;
+		uint8_t *buf;
+
+		WaitForSingleObject(wr_p->full_sem, INFINITE);
+		len = wr_p->lens[wr_p->write_idx];
+		if (len == 0) break;	// end of stream marker
+		buf = wr_p->bufs[wr_p->write_idx];
+
+		wlen = len;
+		if (wr_p->direct && (wlen % WRITER_SECTOR_SIZE) != 0) {
+			// unbuffered writes must be whole sectors, the tail is truncated in end_writer()
+			wlen += WRITER_SECTOR_SIZE - (wlen % WRITER_SECTOR_SIZE);
+			memset(buf + len, 0, wlen - len);
+		}
+
+		QueryPerformanceCounter(&t0);
+		for (done = 0; done < wlen && wr_p->error == 0; ) {
+			DWORD dwWritten;
+			if (!WriteFile(wr_p->file, buf + done, wlen - done, &dwWritten, NULL)) {
+				// published atomically, the renderer checks it without waiting for the thread
+				InterlockedExchange(&wr_p->error, (LONG)GetLastError());
+				break;
+			}
+			done += dwWritten;
+		}
+		QueryPerformanceCounter(&t1);
+		// the thread keeps its own counters, they are folded into the stage statistics by end_writer()
+		wr_p->write_ticks += t1.QuadPart - t0.QuadPart;
+		wr_p->writes++;
+		if (wr_p->error == 0) wr_p->bytes_written += len;
+
+		wr_p->write_idx = (wr_p->write_idx + 1) % wr_p->n_bufs;
+		ReleaseSemaphore(wr_p->free_sem, 1, NULL);
+	}
+	return 0;
+}
+
+int init_writer(char *file_name, uint32_t buf_size, int n_bufs, int direct) {
+	int i;
+
+	wr_p = calloc(1, sizeof(WRITER_params));
+	if (wr_p == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	if (n_bufs < 2) n_bufs = 2;
+	buf_size -= buf_size % WRITER_SECTOR_SIZE;
+	if (buf_size == 0) buf_size = WRITER_SECTOR_SIZE;
+	wr_p->buf_size = buf_size;
+	wr_p->n_bufs = n_bufs;
+	QueryPerformanceFrequency(&wr_p->ticks_per_second);
+
+	if (!strcmp(file_name, "-")) {
+		wr_p->is_stdout = 1;
+		wr_p->file = GetStdHandle(STD_OUTPUT_HANDLE);
+		if (wr_p->file == INVALID_HANDLE_VALUE) {
+			set_error(ERR_WIN32, "[GetStdHandle]");
+			return (-1);
+		}
+	} else {
+		wr_p->direct = direct;
+		wr_p->file = CreateFile(file_name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			direct ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : FILE_ATTRIBUTE_NORMAL, NULL);
+		if (wr_p->file == INVALID_HANDLE_VALUE) {
+			set_error(ERR_WIN32, "[CreateFile] Can't open output file '%s'", file_name);
+			return (-1);
+		}
+	}
+
+	wr_p->bufs = calloc(n_bufs, sizeof(uint8_t *));
+	if (wr_p->bufs == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	wr_p->lens = calloc(n_bufs, sizeof(uint32_t));
+	if (wr_p->lens == NULL) {
+		set_error(ERR_ERRNO, "[malloc]");
+		return (-1);
+	}
+	STATS_ALLOC(STAGE_SETUP);
+	for (i = 0; i < n_bufs; i++) {
+		// VirtualAlloc returns page aligned memory as unbuffered I/O requires
+		wr_p->bufs[i] = VirtualAlloc(NULL, buf_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (wr_p->bufs[i] == NULL) {
+			set_error(ERR_WIN32, "[VirtualAlloc]");
+			return (-1);
+		}
+		STATS_ALLOC(STAGE_SETUP);
+	}
+
+	wr_p->free_sem = CreateSemaphore(NULL, n_bufs, n_bufs, NULL);
+	wr_p->full_sem = CreateSemaphore(NULL, 0, n_bufs, NULL);
+	if (wr_p->free_sem == NULL || wr_p->full_sem == NULL) {
+		set_error(ERR_WIN32, "[CreateSemaphore]");
+		return (-1);
+	}
+	wr_p->thread = CreateThread(NULL, 0, writer_thread, NULL, 0, NULL);
+	if (wr_p->thread == NULL) {
+		set_error(ERR_WIN32, "[CreateThread]");
+		return (-1);
+	}
+	return 0;
+}
+
+static void acquire_buffer(void) {
+	LARGE_INTEGER t0, t1;
+	if (wr_p->has_buf) return;
+	if (WaitForSingleObject(wr_p->free_sem, 0) != WAIT_OBJECT_0) {
+		QueryPerformanceCounter(&t0);
+		WaitForSingleObject(wr_p->free_sem, INFINITE);
+		QueryPerformanceCounter(&t1);
+		wr_p->blocked_ticks += t1.QuadPart - t0.QuadPart;
+		wr_p->blocked_waits++;
+	}
+	wr_p->has_buf = 1;
+}
+
+uint8_t *writer_buffer(void) {
+	acquire_buffer();
+	return wr_p->bufs[wr_p->fill_idx];
+}
+
+int writer_submit(uint32_t len) {
+	if (wr_p->error) {
+		SetLastError((DWORD)wr_p->error);
+		set_error(ERR_WIN32, "[WriteFile]");
+		return (-1);
+	}
+	if (len == 0) return 0;
+	acquire_buffer();
+	wr_p->lens[wr_p->fill_idx] = len;
+	wr_p->fill_idx = (wr_p->fill_idx + 1) % wr_p->n_bufs;
+	wr_p->has_buf = 0;
+	wr_p->bytes_submitted += len;
+	ReleaseSemaphore(wr_p->full_sem, 1, NULL);
+	return 0;
+}
+
+// copying interface for callers producing data in their own buffers, only full buffers are submitted
+int writer_write(uint8_t *buf, uint32_t len) {
+	while (len != 0) {
+		uint32_t l = wr_p->buf_size - wr_p->fill_len;
+		if (l > len) l = len;
+		memcpy(writer_buffer() + wr_p->fill_len, buf, l);
+		wr_p->fill_len += l;
+		buf += l; len -= l;
+		if (wr_p->fill_len == wr_p->buf_size) {
+			wr_p->fill_len = 0;
+			if (writer_submit(wr_p->buf_size) == (-1)) return (-1);
+		}
+	}
+	return 0;
+}
+
+int end_writer(void) {
+	if (wr_p->fill_len != 0) {
+		uint32_t len = wr_p->fill_len;
+		wr_p->fill_len = 0;
+		if (writer_submit(len) == (-1)) return (-1);
+	}
+	// zero length buffer stops the writer thread after all pending ones are written
+	acquire_buffer();
+	wr_p->lens[wr_p->fill_idx] = 0;
+	wr_p->has_buf = 0;
+	ReleaseSemaphore(wr_p->full_sem, 1, NULL);
+	WaitForSingleObject(wr_p->thread, INFINITE);
+	CloseHandle(wr_p->thread);
+
+	if (wr_p->error) {
+		SetLastError((DWORD)wr_p->error);
+		set_error(ERR_WIN32, "[WriteFile]");
+		return (-1);
+	}
+	if (wr_p->direct && (wr_p->bytes_written % WRITER_SECTOR_SIZE) != 0) {
+		LARGE_INTEGER pos;
+		pos.QuadPart = wr_p->bytes_written;
+		if (!SetFilePointerEx(wr_p->file, pos, NULL, FILE_BEGIN) || !SetEndOfFile(wr_p->file)) {
+			set_error(ERR_WIN32, "[SetEndOfFile]");
+			return (-1);
+		}
+	}
+	if (!wr_p->is_stdout) CloseHandle(wr_p->file);
+	STATS_COUNTER("io_blocked_seconds", (double)wr_p->blocked_ticks / (double)wr_p->ticks_per_second.QuadPart);
+	STATS_COUNTER("io_blocked_waits", wr_p->blocked_waits);
+	STATS_COUNTER("io_write_seconds", (double)wr_p->write_ticks / (double)wr_p->ticks_per_second.QuadPart);
+	STATS_ADD(STAGE_WRITE, wr_p->write_ticks, wr_p->writes, wr_p->bytes_written, 0);
+	return 0;
+}
+
+WRITER_params *get_writer_params(void) {
+	return wr_p;
+}
@@ -0,0 +1,35 @@
+#include <stdint.h>
+#include <windows.h>
+
+#define	WRITER_BUF_SIZE		0x100000	// default size of one buffer in bytes
+#define	WRITER_N_BUFS		4			// default number of buffers in the pool
+#define	WRITER_SECTOR_SIZE	4096		// alignment of unbuffered (direct) writes
+
+typedef struct WRITER_params {
+	HANDLE file;
+	HANDLE thread;
+	HANDLE free_sem, full_sem;	// counts of empty and filled buffers
+	uint8_t **bufs;
+	uint32_t *lens;
+	uint32_t buf_size;
+	int n_bufs;
+	int direct, is_stdout;
+	int fill_idx, write_idx;	// buffer being filled by the renderer / written by the thread
+	int has_buf;				// renderer holds bufs[fill_idx]
+	uint32_t fill_len;			// bytes copied into bufs[fill_idx] by writer_write
+	volatile LONG error;		// Win32 error code of the failed write, 0 if none; set with InterlockedExchange()
+	uint64_t bytes_submitted;
+	uint64_t bytes_written;
+	LARGE_INTEGER ticks_per_second;
+	uint64_t blocked_ticks;		// renderer waiting for a free buffer
+	uint32_t blocked_waits;
+	uint64_t write_ticks;		// writer thread inside WriteFile
+	uint64_t writes;			// buffers written by the thread
+} WRITER_params;
+
+int init_writer(char *file_name, uint32_t buf_size, int n_bufs, int direct);
+uint8_t *writer_buffer(void);
+int writer_submit(uint32_t len);
+int writer_write(uint8_t *buf, uint32_t len);
+int end_writer(void);
+WRITER_params *get_writer_params(void);
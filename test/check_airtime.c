@@ -0,0 +1,167 @@
+/*
+File:	check_airtime.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Renders transmissions through the I/Q and audio renderers and checks the samples and bytes they put out
+against air_count_iq() and air_count_wav(). The writer is replaced with a counter, nothing is written.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pocsag2sdr.h"
+#include "airtime.h"
+#include "fsk.h"
+#include "wav.h"
+#include "writer.h"
+
+#define	CHECK_BUF_SIZE	4096	// small, so the renderers flush often
+
+static WRITER_params wr;
+static uint8_t wr_buf[CHECK_BUF_SIZE];
+
+uint8_t *writer_buffer(void) {
+	return wr_buf;
+}
+
+int writer_submit(uint32_t len) {
+	wr.bytes_submitted += len;
+	return 0;
+}
+
+int writer_write(uint8_t *buf, uint32_t len) {
+	wr.bytes_submitted += len;
+	return 0;
+}
+
+int end_writer(void) {
+	return 0;
+}
+
+WRITER_params *get_writer_params(void) {
+	return &wr;
+}
+
+static int failed;
+
+static POCSAG_tx *make_seg(uint32_t baud, uint64_t start_ms, uint32_t capcode, char *msg) {
+	POCSAG_tx *seg = create_preamble();
+	if (seg == NULL) return NULL;
+	seg->baud_rate = baud;
+	seg->start_ms = start_ms;
+	if (add_message(seg, capcode, 2, (uint8_t *)msg, 0) == (-1)) return NULL;
+	return seg;
+}
+
+// the segment loop of main(): the rate is switched first, then a timed segment is placed at its start time
+static int render(POCSAG_tx *p_tx, uint32_t sample_rate, double lead, int timed,
+	int (*set_bit_rate)(uint32_t bps), int (*start_offset)(double offset), int (*output_bit)(int bit)) {
+	POCSAG_tx *seg;
+	uint32_t baud_rate = p_tx->baud_rate;
+	for (seg = p_tx; seg != NULL; seg = seg->next) {
+		seg->cur_btch = NULL;
+		seg->cur_idx = seg->isEOL = 0;
+		if (seg->baud_rate != baud_rate) {
+			baud_rate = seg->baud_rate;
+			if (set_bit_rate(baud_rate) == (-1)) return (-1);
+		}
+		if (timed && start_offset(lead + (double)seg->start_ms * sample_rate / 1000.0) == (-1)) return (-1);
+		if (pocsag_out(seg, output_bit, seg->inv, 0, stderr) == (-1)) return (-1);
+	}
+	return 0;
+}
+
+static void compare(char *what, char *name, uint32_t sample_rate, double lead, uint64_t samples, AIR_count *ac) {
+	if (samples == ac->samples && wr.bytes_submitted == ac->bytes) return;
+	fprintf(stderr, "FAILED %s %s, %lu samples/s, lead %lf: rendered %llu samples %llu bytes, counted %llu samples %llu bytes\n",
+		what, name, (unsigned long)sample_rate, lead, (unsigned long long)samples, (unsigned long long)wr.bytes_submitted,
+		(unsigned long long)ac->samples, (unsigned long long)ac->bytes);
+	failed++;
+}
+
+// exact is what a start time sets, timed what a queue sets
+static int check_iq(char *name, POCSAG_tx *p_tx, uint32_t sample_rate, int exact, double lead, int timed) {
+	AIR_count ac;
+	memset(&wr, 0, sizeof(wr));
+	wr.buf_size = CHECK_BUF_SIZE;
+	if (init_fsk(sample_rate, 4500, p_tx->baud_rate, 64) == (-1)) return (-1);
+	if (exact && fsk_start_offset(lead) == (-1)) return (-1);
+	if (render(p_tx, sample_rate, lead, timed, fsk_set_bit_rate, fsk_start_offset, fsk_output_bit) == (-1)) return (-1);
+	if (end_fsk() == (-1)) return (-1);
+	air_count_iq(p_tx, sample_rate, exact, lead, timed, &ac);
+	compare("I/Q", name, sample_rate, lead, get_fsk_params()->samples, &ac);
+	return 0;
+}
+
+static int check_wav(char *name, POCSAG_tx *p_tx, uint32_t sample_rate, uint32_t lpf, int header, double lead, int timed) {
+	AIR_count ac;
+	memset(&wr, 0, sizeof(wr));
+	wr.buf_size = CHECK_BUF_SIZE;
+	// "-" is stdout, so the header isn't patched at the end
+	if (init_wav("-", sample_rate, p_tx->baud_rate, WAV_AMPLITUDE, lpf, header) == (-1)) return (-1);
+	if (lead > 0 && wav_start_offset(lead) == (-1)) return (-1);
+	if (render(p_tx, sample_rate, lead, timed, wav_set_bit_rate, wav_start_offset, wav_output_bit) == (-1)) return (-1);
+	if (end_wav() == (-1)) return (-1);
+	air_count_wav(p_tx, sample_rate, lead, timed, header, &ac);
+	compare(lpf ? "filtered audio" : "audio", name, sample_rate, lead, get_wav_params()->samples, &ac);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	static uint32_t iq_rates[] = { 1000000, 2400000, 44100 };
+	static uint32_t wav_rates[] = { 48000, 22050, 8000 };
+	static double leads[] = { 0, 1234.567, 0.25 };
+	POCSAG_tx *chains[2];
+	static char *names[] = { "multi-rate queue", "single rate" };
+	int i, j, k, n = 0;
+
+	// 512 bps first, the 1200 bps segment is due while it's still on air, the 2400 bps one after a pause
+	chains[0] = make_seg(512, 250, 1234567, "Hello world test");
+	if (chains[0] == NULL || (chains[0]->next = make_seg(1200, 1000, 7654321, "overlapping")) == NULL
+		|| (chains[0]->next->next = make_seg(2400, 6000, 1111111, "a longer page that takes a few batches at the highest rate")) == NULL) {
+		fprintf(stderr, "[make_seg]%s\n", my_strerror());
+		return 1;
+	}
+	chains[1] = make_seg(1200, 0, 1234567, "Hello world test");
+	if (chains[1] == NULL) {
+		fprintf(stderr, "[make_seg]%s\n", my_strerror());
+		return 1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < sizeof(iq_rates) / sizeof(iq_rates[0]); j++) {
+			for (k = 0; k < sizeof(leads) / sizeof(leads[0]); k++) {
+				if (check_iq(names[i], chains[i], iq_rates[j], 1, leads[k], 1) == (-1)
+					|| check_iq(names[i], chains[i], iq_rates[j], 1, leads[k], 0) == (-1)) {
+					fprintf(stderr, "[check_iq]%s\n", my_strerror());
+					return 1;
+				}
+				n += 2;
+			}
+			// untimed without a start time, rounded samples per bit
+			if (check_iq(names[i], chains[i], iq_rates[j], 0, 0, 0) == (-1)) {
+				fprintf(stderr, "[check_iq]%s\n", my_strerror());
+				return 1;
+			}
+			n++;
+		}
+		for (j = 0; j < sizeof(wav_rates) / sizeof(wav_rates[0]); j++) {
+			for (k = 0; k < sizeof(leads) / sizeof(leads[0]); k++) {
+				if (check_wav(names[i], chains[i], wav_rates[j], 0, 1, leads[k], 1) == (-1)
+					|| check_wav(names[i], chains[i], wav_rates[j], 0, 0, leads[k], 0) == (-1)
+					|| check_wav(names[i], chains[i], wav_rates[j], 3000, 1, leads[k], 1) == (-1)
+					|| check_wav(names[i], chains[i], wav_rates[j], 3000, 0, leads[k], 0) == (-1)) {
+					fprintf(stderr, "[check_wav]%s\n", my_strerror());
+					return 1;
+				}
+				n += 4;
+			}
+		}
+	}
+	printf("%s: %d of %d renders match the counts\n", failed ? "FAILED" : "OK", n - failed, n);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+/*
+File:	check_duty.c
+Author:	(C) Alexey Kuznetsov, avk@itn.ru
+
+Runs a random queue through the duty cycle governor and checks every window of the resulting schedule
+against the budget by brute force: if nothing overruns, no window is keyed for more than duty_pct percent
+of its length, and duty_peak stays within duty_pct.
+
+This code can be freely used for any personal and non-commercial purposes provided this copyright notice is preserved.
+For any other purposes please contact me at e-mail above or any other e-mail listed at https://github.com/avk-sw/pocsag2sdr
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pocsag2sdr.h"
+#include "pocsag_sched.h"
+
+#define	CHECK_PAGES		2000
+#define	CHECK_BAUD		1200
+#define	CHECK_WINDOW_MS	60000
+#define	CHECK_OVERHEAD	300		// PTT delay, ms
+
+static uint32_t seed = 12345;
+
+// the same sequence everywhere, unlike rand()
+static uint32_t lcg(uint32_t n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+// keyed time of the intervals between from_ms and to_ms
+static uint64_t keyed(SCHED_keyed *iv, uint32_t n, int64_t from_ms, int64_t to_ms) {
+	uint64_t used = 0;
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		int64_t a = (int64_t)iv[i].start_ms > from_ms ? (int64_t)iv[i].start_ms : from_ms;
+		int64_t b = (int64_t)iv[i].end_ms < to_ms ? (int64_t)iv[i].end_ms : to_ms;
+		if (b > a) used += (uint64_t)(b - a);
+	}
+	return used;
+}
+
+static int check(double duty_pct) {
+	static char *msgs[] = { "short", "Hello world test", "a page of medium length, a couple of batches",
+		"a long page which takes several batches to send at 1200 bps, so transmissions differ a lot in length" };
+	SCHED_queue *q;
+	SCHED_keyed *iv;
+	POCSAG_tx *seg;
+	uint64_t now_ms = 0, arrival_ms = 0, budget, worst = 0;
+	uint32_t i, j, n = 0;
+	int rc;
+
+	q = create_sched();
+	iv = malloc(CHECK_PAGES * sizeof(SCHED_keyed));
+	if (q == NULL || iv == NULL) return (-1);
+	q->tx_overhead_ms = CHECK_OVERHEAD;
+	if (sched_set_duty(q, duty_pct, CHECK_WINDOW_MS) == (-1)) return (-1);
+	// bursts of arrivals with pauses, so the governor both delays and lets the window drain
+	for (i = 0; i < CHECK_PAGES; i++) {
+		arrival_ms += lcg(10) < 8 ? lcg(500) : lcg(120000);
+		if (sched_add(q, 1000000 + lcg(1000000), lcg(4), (uint8_t *)msgs[lcg(4)], 0, (int)lcg(3), arrival_ms, 0) == (-1)) return (-1);
+	}
+	while ((rc = sched_next_tx(q, &now_ms, CHECK_BAUD, 0, 0, &seg)) == 1) {
+		iv[n].start_ms = seg->start_ms;
+		iv[n].end_ms = now_ms;
+		n++;
+		free_tx(seg);
+	}
+	if (rc == (-1)) return (-1);
+
+	// the busiest window either ends with an interval or starts with one
+	budget = (uint64_t)(duty_pct / 100.0 * CHECK_WINDOW_MS);
+	for (i = 0; i < n; i++) {
+		uint64_t k1 = keyed(iv, n, (int64_t)iv[i].end_ms - CHECK_WINDOW_MS, (int64_t)iv[i].end_ms);
+		uint64_t k2 = keyed(iv, n, (int64_t)iv[i].start_ms, (int64_t)iv[i].start_ms + CHECK_WINDOW_MS);
+		if (k1 > worst) worst = k1;
+		if (k2 > worst) worst = k2;
+	}
+	for (i = 1, j = 0; i < n; i++) {
+		if (iv[i].start_ms < iv[i - 1].end_ms) j++;
+	}
+	printf("%.1lf%% of %d secs: %lu pages in %lu transmissions, %lu delayed, busiest window %.2lf%%, duty_peak %.2lf%%, %lu overruns\n",
+		duty_pct, CHECK_WINDOW_MS / 1000, (unsigned long)q->pages_sent, (unsigned long)n, (unsigned long)q->duty_delays,
+		100.0 * (double)worst / CHECK_WINDOW_MS, q->duty_peak, (unsigned long)q->duty_overruns);
+	rc = 0;
+	if (j != 0) {
+		fprintf(stderr, "FAILED: %lu transmissions overlap the previous one\n", (unsigned long)j);
+		rc = 1;
+	}
+	if (q->duty_overruns == 0 && worst > budget) {
+		fprintf(stderr, "FAILED: a window is keyed for %llu msecs, over the budget of %llu msecs\n",
+			(unsigned long long)worst, (unsigned long long)budget);
+		rc = 1;
+	}
+	if (q->duty_overruns == 0 && q->duty_peak > duty_pct) {
+		fprintf(stderr, "FAILED: duty_peak %lf%% is over the limit of %lf%%\n", q->duty_peak, duty_pct);
+		rc = 1;
+	}
+	if (q->duty_peak > 100.0 * (double)worst / CHECK_WINDOW_MS + 1e-9) {
+		fprintf(stderr, "FAILED: duty_peak %lf%% is over the busiest window\n", q->duty_peak);
+		rc = 1;
+	}
+	free(iv);
+	free_sched(q);
+	return rc;
+}
+
+int main(int argc, char *argv[]) {
+	static double limits[] = { 10, 5, 33.3 };
+	int i, rc, failed = 0;
+	for (i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+		rc = check(limits[i]);
+		if (rc == (-1)) {
+			fprintf(stderr, "[check]%s\n", my_strerror());
+			return 1;
+		}
+		failed += rc;
+	}
+	printf("%s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+@echo off
+rem builds and runs the consistency checks; run it from the test directory in a Visual Studio developer command prompt
+cl /nologo /W3 /O2 /DWIN32 /I..\src check_airtime.c ..\src\airtime.c ..\src\fsk.c ..\src\wav.c ..\src\pocsag.c ..\src\pocsag_bch.c ..\src\pocsag_out.c ..\src\my_strerror.c ..\src\stats.c || exit /b 1
+cl /nologo /W3 /O2 /DWIN32 /I..\src check_duty.c ..\src\pocsag_sched.c ..\src\pocsag.c ..\src\pocsag_bch.c ..\src\my_strerror.c ..\src\stats.c || exit /b 1
+check_airtime || exit /b 1
+check_duty || exit /b 1